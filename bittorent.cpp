@@ -1,18 +1,29 @@
 #include "clients/clients.h"
+#include "include/simulator.h"
 #include "server/server.h"
+#include "utils/logger.h"
 
+#include <cstring>
 #include <fstream>
 #include <thread>
 
 using namespace std;
 
 int main (int argc, char **argv) {
-    // Initialize MPI with multithreading support
+    // Simulated swarms run in this single process, MPI is never initialized
+    if (argc > 1 && strcmp(argv[1], "--simulate") == 0) {
+        log_init(TRACKER_RANK);
+        int status = simulate();
+        log_shutdown();
+        return status;
+    }
+
+    // Initialize MPI, only the main thread of a rank calls it (client engine or tracker)
     int provided;
-    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     // Check if MPI supports multithreading
-    if (provided < MPI_THREAD_MULTIPLE) {
+    if (provided < MPI_THREAD_FUNNELED) {
         fprintf(stderr, "MPI nu are suport pentru multi-threading\n");
         exit(EXIT_FAILURE);
     }
@@ -21,12 +32,16 @@ int main (int argc, char **argv) {
     MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    // Records are formatted by a background thread, off the tracker loop
+    log_init(rank);
+
     if (rank == TRACKER_RANK) {
         tracker(numtasks, rank);
     } else {
         peer(numtasks, rank);
     }
 
+    log_shutdown();
     MPI_Finalize();
     return EXIT_SUCCESS;
 }
@@ -5,7 +5,7 @@ total=0
 
 # afiseaza scorul final
 function show_score {
-	echo "Total: $total/40"
+	echo "Total: $total/50"
 }
 
 function run_timeout {
@@ -129,6 +129,30 @@ function test4 {
 	echo ""
 }
 
+# reluarea unei descarcari din checkpoint-uri: client3 are jumatate din file1
+# (un segment corupt si o ultima intrare trunchiata), client4 un header trunchiat
+function test5 {
+	echo "Se ruleaza testul 5..."
+	cp tests/test5/* .
+	correct=0
+	run_timeout "mpirun --oversubscribe -np 5 ./bittorent"
+	compare_files client1_file2 out2.txt
+	compare_files client2_file1 out1.txt
+	compare_files client3_file1 out1.txt
+	compare_files client4_file2 out2.txt
+	if [ $correct == 4 ] && [ ! -f client3_file1.ckpt ] && [ ! -f client4_file2.ckpt ]
+	then
+	    total=$((total+10))
+	    echo "OK"
+	else
+		echo "Testul 5 a picat"
+	fi
+	rm -rf client*_file*
+	rm -rf in*txt
+	rm -rf out*txt
+	echo ""
+}
+
 # printeaza informatii despre rulare
 echo "VMCHECKER_TRACE_CLEANUP"
 date
@@ -138,6 +162,17 @@ export OMPI_ALLOW_RUN_AS_ROOT_CONFIRM=1
 
 # se compileaza tema
 cd ../
+# fiecare nivel de logare trebuie sa compileze fara avertismente
+make levels &> checker.txt
+if [ $? != 0 ]
+then
+    echo "E: Nu s-au putut compila toate nivelurile de logare fara avertismente"
+    cat checker.txt
+    show_score
+    rm -rf checker.txt
+    exit
+fi
+
 make clean &> /dev/null
 make build &> checker.txt
 
@@ -160,6 +195,7 @@ test1
 test2
 test3
 test4
+test5
 
 cd ../
 make clean &> /dev/null
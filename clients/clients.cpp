@@ -1,15 +1,15 @@
 #include "clients.h"
+#include "../utils/logger.h"
 
 #include <mpi.h>
+#include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
-#include <iostream>
 #include <thread>
 
 using namespace std;
 
-static char recvMsg;
-
 /**
  * @brief Reads client files from a text document and stores them in the appropriate data structures.
  *
@@ -65,25 +65,82 @@ void read_client_files(unordered_map<string, hashes>& files, vector<string>& fil
 }
 
 /**
- * @brief Sends file information (filename and hashes) to the trackedfile.
+ * @brief Loads the checkpoints left by a previous run for the wanted files.
+ *
+ * @param fileNames Reference to a vector containing the wanted filenames.
+ * @param resumed Reference to an unordered_map receiving the verified segments by filename.
+ * @param rank The rank of the current client.
+ */
+void read_checkpoints(const vector<string>& fileNames, unordered_map<string, hashes>& resumed, int rank) {
+    for (const auto& fileName : fileNames) {
+        vector<string> segments;
+        if (checkpoint_load(rank, fileName, segments) > 0) {
+            resumed[fileName] = {(int) segments.size(), segments};
+        }
+    }
+}
+
+/**
+ * @brief Packs the client manifest (owned files with hashes, wanted file names,
+ * resumed progress) and gathers it on the tracker.
  *
  * @param files Reference to an unordered_map containing file hashes indexed by filename.
+ * @param fileNames Reference to a vector containing the wanted filenames.
+ * @param resumed Reference to an unordered_map containing the segments restored from checkpoints.
  * @param rank The rank of the current client.
  */
-void send_file(const unordered_map<string, hashes>& files, int rank) {
-    int filesNo = files.size();
-    MPI_Send(&filesNo, 1, MPI_INT, 0, 1, MPI_COMM_WORLD);
+void send_file(const unordered_map<string, hashes>& files, const vector<string>& fileNames,
+    const unordered_map<string, hashes>& resumed, int rank) {
+
+    manifestheader header = {(int) files.size(), (int) fileNames.size(), (int) resumed.size()};
+    vector<char> manifest(sizeof(manifestheader));
+    memcpy(manifest.data(), &header, sizeof(manifestheader));
 
-    // Iterate over each file and send its information to the trackedfile
+    // Owned files, each one followed by its hashes
     for (const auto& [fileName, data] : files) {
-        MPI_Send(fileName.c_str(), MAX_FILENAME, MPI_CHAR, 0, 1, MPI_COMM_WORLD);
-        MPI_Send(&data.hashesNo, 1, MPI_INT, 0, 1, MPI_COMM_WORLD);
+        manifestfile entry;
+        memset(entry.fileName, 0, sizeof(char) * MAX_FILENAME);
+        strncpy(entry.fileName, fileName.c_str(), MAX_FILENAME - 1);
+        entry.hashesNo = data.hashesNo;
+
+        size_t offset = manifest.size();
+        manifest.resize(offset + sizeof(manifestfile) + data.hashesNo * HASH_SIZE, 0);
+        memcpy(manifest.data() + offset, &entry, sizeof(manifestfile));
+        offset += sizeof(manifestfile);
 
-        // Send each hash line by line
         for (const auto& line : data.hashesCurr) {
-            MPI_Send(line.c_str(), HASH_SIZE, MPI_CHAR, 0, 1, MPI_COMM_WORLD);
+            memcpy(manifest.data() + offset, line.c_str(), min(line.size(), (size_t) HASH_SIZE));
+            offset += HASH_SIZE;
+        }
+    }
+
+    // Wanted files
+    for (const auto& fileName : fileNames) {
+        size_t offset = manifest.size();
+        manifest.resize(offset + MAX_FILENAME, 0);
+        strncpy(manifest.data() + offset, fileName.c_str(), MAX_FILENAME - 1);
+    }
+
+    // Resumed files, the tracker lists the client as a provider of their owned prefix
+    for (const auto& [fileName, data] : resumed) {
+        progressentry entry;
+        memset(entry.fileName, 0, sizeof(char) * MAX_FILENAME);
+        strncpy(entry.fileName, fileName.c_str(), MAX_FILENAME - 1);
+        entry.segmentLast = 0;
+        entry.offered.first = entry.offered.last = 0;
+        while (entry.segmentLast < data.hashesNo && !data.hashesCurr[entry.segmentLast].empty()) {
+            entry.segmentLast++;
         }
+
+        size_t offset = manifest.size();
+        manifest.resize(offset + sizeof(progressentry));
+        memcpy(manifest.data() + offset, &entry, sizeof(progressentry));
     }
+
+    int size = manifest.size();
+    MPI_Gather(&size, 1, MPI_INT, nullptr, 1, MPI_INT, TRACKER_RANK, MPI_COMM_WORLD);
+    MPI_Gatherv(manifest.data(), size, MPI_BYTE, nullptr, nullptr, nullptr,
+        MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
 }
 
 /**
@@ -96,20 +153,53 @@ void peer(int numtasks, int rank) {
     unordered_map<string, hashes> files;
     vector<string> fileNames;
     int filesNo = 0;
+    swarmconfig config;
 
     // Read client files and prepare for communication
     read_client_files(files, fileNames, filesNo, rank);
-    // Send file information to the trackedfile and wait for acknowledgement
-    send_file(files, rank);
-
-    MPI_Recv(&recvMsg, 1, MPI_CHAR, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    if (recvMsg != ACK) {
-        cout << "Trackedfile did not receive the data, client: " << rank << "\n";
+    // Partial downloads of a previous run are resumed
+    unordered_map<string, hashes> resumed;
+    read_checkpoints(fileNames, resumed, rank);
+    // Send the manifest to the trackedfile and wait for acknowledgement
+    send_file(files, fileNames, resumed, rank);
+
+    // Acknowledgement comes with the run configuration
+    MPI_Bcast(&config, sizeof(swarmconfig), MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
+    if (config.status != ACK) {
+        LOG_ERROR("tracker_no_ack", TRACKER_RANK, nullptr, LOG_NONE, config.status);
     }
 
-    // Initialize downloading and uploading threads
-    thread download(download_thread, rank, filesNo, fileNames.data());
-    thread upload(upload_thread, files, rank);
+    // Owned segments are exposed through the windows, the catalog comes from the tracker
+    segmentwindow window;
+    filecatalog catalog;
+    window_setup(window, catalog, config, numtasks, rank);
+
+    // Owned segments are shared by both threads
+    localstore store;
+    store.window = &window;
+    store_owned_files(store, files);
+    store_owned_files(store, resumed);
+    peerstats stats;
+    memset(&stats, 0, sizeof(peerstats));
+
+    // Initialize downloading and uploading threads, they reach MPI through the engine
+    commengine engine;
+    engine.window = &window;
+    thread download([&]() {
+        download_thread(rank, filesNo, fileNames.data(), config, engine, store, stats);
+        engine.downloadDone.store(true, memory_order_release);
+    });
+    thread upload([&]() {
+        upload_thread(engine, store, stats, rank);
+        engine.uploadDone.store(true, memory_order_release);
+    });
+
+    // This thread initialized MPI and is the only one calling it
+    engine_run(engine);
     download.join();
     upload.join();
+    window_free(window);
+
+    // Report download and upload statistics to the tracker
+    gather_stats(stats, numtasks, rank);
 }
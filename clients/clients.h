@@ -5,6 +5,7 @@
 
 #include "../include/upload.h"
 #include "../include/download.h"
+#include "../utils/config.h"
 
 #include <string>
 #include <vector>
@@ -31,12 +32,28 @@ void read_client_files(
     std::vector<std::string>& fileNames, int& filesNo, int rank);
 
 /**
- * @brief Sends file information (filename and hashes) to the trackedfile.
+ * @brief Loads the checkpoints left by a previous run for the wanted files.
+ *
+ * @param fileNames Reference to a vector containing the wanted filenames.
+ * @param resumed Reference to an unordered_map receiving the verified segments by filename.
+ * @param rank The rank of the current client.
+ */
+void read_checkpoints(
+    const std::vector<std::string>& fileNames,
+    std::unordered_map<std::string, hashes>& resumed, int rank);
+
+/**
+ * @brief Packs the client manifest (owned files with hashes, wanted file names,
+ * resumed progress) and gathers it on the tracker.
  *
  * @param files Reference to an unordered_map containing file hashes indexed by filename.
+ * @param fileNames Reference to a vector containing the wanted filenames.
+ * @param resumed Reference to an unordered_map containing the segments restored from checkpoints.
  * @param rank The rank of the current client.
  */
 void send_file(
-    const std::unordered_map<std::string, hashes>& files, int rank);
+    const std::unordered_map<std::string, hashes>& files,
+    const std::vector<std::string>& fileNames,
+    const std::unordered_map<std::string, hashes>& resumed, int rank);
 
 #endif // PEER_CLIENTS_H
@@ -3,22 +3,62 @@
 #ifndef DOWNLOAD_CLIENTS_H
 #define DOWNLOAD_CLIENTS_H 1
 
+#include "engine.h"
+#include "../utils/checkpoint.h"
 #include "../utils/file_info.h"
+#include "../utils/config.h"
+#include "../utils/metrics.h"
+#include "../utils/policy.h"
+#include "../utils/store.h"
 
+#include <random>
 #include <string>
+#include <vector>
 #include <unistd.h>
 
+#define FETCH_MESSAGE 0                 // Request served by the upload thread of the provider
+#define FETCH_COPY 1                    // Copy of the provider slot, same node
+#define FETCH_GET 2                     // MPI_Get of the provider slot, issued by the engine
+
+struct segmentfetch {
+    int provider;                       // Client asked for the segment
+    int path;                           // FETCH_MESSAGE, FETCH_COPY or FETCH_GET
+    int slot;                           // Slot of the segment in the windows, -1 if not exposed
+    bool alias;                         // Provider owns the hash under another file or index
+    bool offered;                       // Segment a super seed advertises to this client only
+    segmentrequest request;             // Request sent to the provider
+    segmentreply reply;                 // Reply received from the provider
+};
+
+struct filestate {
+    std::vector<char> owned;            // Segments already downloaded and verified
+    bool endgame;                       // Endgame mode was entered for the file
+    checkpoint log;                     // Verified segments, survives a restart
+    roundpolicy policy;                 // Batch and refresh interval of the file
+};
+
+struct progressbatch {
+    std::vector<progressentry> entries; // Newest progress of every file, one entry per file
+    int pendingSegments;                // Segments acquired since the last flush
+    double lastFlush;                   // Time of the last flush (now_seconds, steady clock)
+};
+
 /**
  * @brief Main function for the download thread.
  * 
  * @param rank The rank of the current MPI task.
  * @param fileNo The number of files to download.
  * @param fileNames Pointer to an array of file names.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param engine Reference to the communication engine of the client.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics gathered at shutdown.
  */
-void download_thread(int rank, int fileNo, void* fileNames);
+void download_thread(int rank, int fileNo, void* fileNames, swarmconfig config,
+    commengine& engine, localstore& store, peerstats& stats);
 
 /**
- * @brief Receives file swarm information from the coordinator.
+ * @brief Receives file swarm information from the coordinator, packed in one message.
  * 
  * @param segmentsNo Reference to store the number of members.
  * @param rank The rank of the current MPI task.
@@ -27,31 +67,148 @@ void download_thread(int rank, int fileNo, void* fileNames);
 trackedfile receive_file_swarm(int& segmentsNo, int rank);
 
 /**
- * @brief Sends file swarm information to the coordinator.
+ * @brief Asks the coordinator for the current swarm of a file.
  * 
- * @param fileNo The number of files to send information for.
- * @param files Array of file names.
+ * @param file Name of the file.
+ * @param segmentsNo Reference to store the number of providers.
+ * @param rank The rank of the current MPI task.
+ * @return The received file swarm information.
+ */
+trackedfile request_file_swarm(const std::string& file, int& segmentsNo, int rank);
+
+/**
+ * @brief Buffers the progress of a file, only the newest progress of a file is kept.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param file Name of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @param acquired Number of segments acquired since the previous record.
+ * @param offered Segments obtained from a super seed beyond segmentLast, empty if none.
+ */
+void record_progress(
+    progressbatch& progress, const std::string& file,
+    int segmentLast, int acquired, hashrange offered);
+
+/**
+ * @brief Sends the buffered progress of every file to the coordinator in one message,
+ * once enough segments were acquired or enough time elapsed since the last flush.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param config Run configuration holding the flush thresholds.
+ * @param force Flush even if neither the count nor the time threshold was reached.
+ */
+void flush_progress(progressbatch& progress, const swarmconfig& config, bool force);
+
+/**
+ * @brief Tells whether the buffered progress has to be flushed, shared with the simulator
+ * which runs on a virtual clock.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param config Run configuration holding the flush thresholds.
+ * @param now Current time in seconds, on the clock of progress.lastFlush.
+ * @param force Flush even if neither the count nor the time threshold was reached.
+ * @return True if something is buffered and a threshold was reached or the flush is forced.
+ */
+bool progress_due(const progressbatch& progress, const swarmconfig& config, double now, bool force);
+
+/**
+ * @brief Picks the (segment, provider) requests of the next round, without any communication
+ * so the simulator takes the same decisions as the clients.
+ * A round fetches state.policy.batch missing segments from one random provider. Once no more than
+ * config.endgameSegments segments are missing, every missing segment is requested from up to
+ * config.endgameProviders providers at once (endgame mode).
+ * 
+ * @param file Name of the file.
  * @param rank The rank of the current MPI task.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @param swarm Reference to the file swarm data, its providers are shuffled.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param state Reference to the download state of the file.
+ * @param stats Reference to the download statistics.
+ * @param g Random generator used to order the providers.
+ * @return The requests of the round.
+ */
+std::vector<segmentfetch> plan_round(
+    const std::string& file, int rank,
+    int segmentLast, trackedfile& swarm,
+    const swarmconfig& config, filestate& state,
+    peerstats& stats, std::mt19937& g);
+
+/**
+ * @brief Advances over the segments owned so far.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @return The number of segments owned without a gap from the first one.
  */
-void send_file_swarm(int fileNo, std::string* files, int rank);
+int advance_segments(const filestate& state, int segmentLast);
 
 /**
- * @brief Processes segments of a file.
+ * @brief Adapts the batch of a file to a completed round, endgame rounds are ignored.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param requested Segments requested in the round.
+ * @param acquired Segments of the round that were verified and stored.
+ * @param elapsed Duration of the round in seconds.
+ */
+void end_round(filestate& state, int requested, int acquired, double elapsed);
+
+/**
+ * @brief Processes segments of a file, one round planned by plan_round.
+ * Local duplicates are taken from the store first, the requests go through the engine
+ * or the segment windows.
  * 
  * @param files Array of file names.
  * @param rank The rank of the current MPI task.
- * @param segmentLast Reference to the last processed segment.
+ * @param segmentLast Reference to the number of segments owned, counted from the first one.
  * @param fIdx Index of the current file being processed.
  * @param swarm Reference to the file swarm data.
- * @param segmentsNo The total number of members.
+ * @param segmentsNo The total number of providers in the swarm.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param state Reference to the download state of the file.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
  */
 void process_file_segments(
     std::string* files, int rank,
     int& segmentLast, int fIdx,
-    trackedfile& swarm, int segmentsNo);
+    trackedfile& swarm, int segmentsNo,
+    const swarmconfig& config, filestate& state,
+    localstore& store, peerstats& stats);
+
+/**
+ * @brief Counts the segments offered by a super seed that are still missing.
+ * 
+ * @param swarm Reference to the file swarm data, holds the offer.
+ * @param state Reference to the download state of the file.
+ * @return The number of missing offered segments, 0 without an offer.
+ */
+int offer_missing(const trackedfile& swarm, const filestate& state);
+
+/**
+ * @brief Picks the offered segments to report beyond the owned prefix.
+ * 
+ * @param swarm Reference to the file swarm data, holds the offer.
+ * @param state Reference to the download state of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @return The fetched offer if it lies beyond segmentLast, empty otherwise.
+ */
+hashrange offered_segments(const trackedfile& swarm, const filestate& state, int segmentLast);
+
+/**
+ * @brief Tells whether the swarm of a file has to be queried again after a round.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param segmentsNo Number of segments of the file.
+ * @param segmentPrev segmentLast before the round.
+ * @param segmentLast segmentLast after the round.
+ * @param segmentRefresh segmentLast at the last swarm query.
+ * @return True if the file is incomplete and the round stalled or the refresh interval elapsed.
+ */
+bool swarm_due(const filestate& state, int segmentsNo, int segmentPrev, int segmentLast, int segmentRefresh);
 
 /**
- * @brief Finalizes file assembly and saves it.
+ * @brief Finalizes file assembly and saves it, progress is reported separately.
  * 
  * @param files Array of file names.
  * @param rank The rank of the current MPI task.
@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef ENGINE_CLIENTS_H
+#define ENGINE_CLIENTS_H 1
+
+#include "../utils/queue.h"
+#include "../utils/window.h"
+
+#include <atomic>
+#include <vector>
+
+#define ENGINE_OUTBOX_SIZE 4096  // Messages waiting to be sent by the engine
+#define ENGINE_INBOX_SIZE 1024   // Messages waiting to be consumed by a client thread
+#define ENGINE_IDLE_US 20        // Pause of the engine when no message moved
+#define ENGINE_WAIT_SPINS 64     // Polls of a client thread before it starts sleeping
+#define ENGINE_RMA_GET -1        // Outbox only, reads a slot of the peer window instead of sending
+
+struct commmessage {
+    int peer;                    // Source of an inbound message, destination of an outbound one
+    int tag;                     // Message tag, tells which thread consumes it
+    std::vector<char> payload;   // Packed message content
+};
+
+// Payload of an ENGINE_RMA_GET, answered with a TAG_SEGMENT_REPLY built by the engine
+struct rmaget {
+    segmentrequest request;      // Segment read from the peer
+    int slot;                    // Slot of the segment in the peer window
+};
+
+typedef mpscqueue<commmessage, ENGINE_OUTBOX_SIZE> commoutbox;
+typedef spscqueue<commmessage, ENGINE_INBOX_SIZE> comminbox;
+
+struct commengine {
+    commoutbox outbox;                  // Download and upload threads -> engine
+    comminbox downloadInbox;            // Engine -> download thread (swarm and segment replies)
+    comminbox uploadInbox;              // Engine -> upload thread (segment requests and cancels)
+    std::atomic<bool> shutdown{false};  // Tracker broadcast FIN
+    std::atomic<bool> downloadDone{false};
+    std::atomic<bool> uploadDone{false};
+    segmentwindow* window = nullptr;    // Windows read with MPI_Get, none when disabled
+};
+
+/**
+ * @brief Runs the communication engine until both client threads are done.
+ * It is the only code of a client calling MPI, so it runs on the thread that
+ * initialized MPI and MPI_THREAD_FUNNELED is enough.
+ *
+ * @param engine Reference to the queues shared with the client threads.
+ */
+void engine_run(commengine& engine);
+
+/**
+ * @brief Queues a message for the engine, waits while the outbox is full.
+ *
+ * @param engine Reference to the communication engine.
+ * @param peer Destination rank.
+ * @param tag Message tag.
+ * @param data Message content.
+ * @param size Size of the content in bytes.
+ */
+void engine_send(commengine& engine, int peer, int tag, const void* data, size_t size);
+
+/**
+ * @brief Takes the next message of an inbox, polling then sleeping while it is empty.
+ *
+ * @param inbox Inbox owned by the calling thread.
+ * @return The oldest message of the inbox.
+ */
+commmessage engine_receive(comminbox& inbox);
+
+#endif // ENGINE_CLIENTS_H
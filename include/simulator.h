@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H 1
+
+#include "../utils/file_info.h"
+
+#define SIM_PEERS 1000              // Virtual clients, seeds included
+#define SIM_SEEDS 4                 // Clients owning the whole file from the start
+#define SIM_SEGMENTS MAX_CHUNKS     // Segments of the simulated file
+#define SIM_SEGMENT_KIB 64          // Size of a segment, drives the transfer times
+#define SIM_LATENCY_US 2000         // Mean one-way latency of an access link
+#define SIM_UPLINK_KIB 4096         // Mean upload bandwidth of a client, KiB per second
+#define SIM_ARRIVAL_MS 1000         // Leechers join uniformly over this window
+#define SIM_CHURN_MS 0              // Mean online time of a leecher before it leaves, 0 disables churn
+#define SIM_DOWNTIME_MS 500         // Time a leecher stays away before rejoining
+#define SIM_SWARM_SAMPLE 50         // Providers returned by a swarm query, 0 returns all of them
+#define SIM_SEED 1                  // Seed of the random generator, runs are reproducible
+#define SIM_LIMIT_S 3600            // Virtual time after which the run stops, finished or not
+#define SIM_BASELINE 1              // Runs the swarm again without endgame mode to report the p99 gain
+
+struct simconfig {
+    int peers;                      // Virtual clients, seeds included
+    int seeds;                      // Clients owning the whole file from the start
+    int segments;                   // Segments of the simulated file
+    int segmentKib;                 // Size of a segment in KiB
+    int latencyUs;                  // Mean one-way latency of an access link
+    int uplinkKib;                  // Mean upload bandwidth of a client, KiB per second
+    int arrivalMs;                  // Leechers join uniformly over this window
+    int churnMs;                    // Mean online time of a leecher, 0 disables churn
+    int downtimeMs;                 // Time a leecher stays away before rejoining
+    int swarmSample;                // Providers returned by a swarm query, 0 returns all of them
+    int seed;                       // Seed of the random generator
+    int limitS;                     // Virtual time after which the run stops, finished or not
+    int baseline;                   // Runs the swarm again without endgame mode, 0 disables it
+};
+
+/**
+ * @brief Builds the simulation parameters, defaults can be overridden with BT_SIM_PEERS,
+ * BT_SIM_SEEDS, BT_SIM_SEGMENTS, BT_SIM_SEGMENT_KIB, BT_SIM_LATENCY_US, BT_SIM_UPLINK_KIB,
+ * BT_SIM_ARRIVAL_MS, BT_SIM_CHURN_MS, BT_SIM_DOWNTIME_MS, BT_SIM_SWARM_SAMPLE, BT_SIM_SEED,
+ * BT_SIM_LIMIT_S and BT_SIM_BASELINE.
+ *
+ * @return The simulation parameters.
+ */
+simconfig load_sim_config(void);
+
+/**
+ * @brief Runs a single threaded discrete-event simulation of one file swarm, without MPI.
+ * Clients plan their rounds with plan_round and the tracker applies progress with
+ * apply_progress, messages are replaced by events delayed by the modelled links.
+ * The run configuration (BT_* variables) is read as on the tracker and the completion
+ * metrics are logged by report_stats, as at the end of an MPI run. With endgame mode on,
+ * the same swarm runs again without it and the p99 completion gain is logged.
+ *
+ * @return The exit status of the process.
+ */
+int simulate(void);
+
+#endif // SIMULATOR_H
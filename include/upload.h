@@ -3,29 +3,54 @@
 #ifndef UPLOAD_CLIENTS_H
 #define UPLOAD_CLIENTS_H 1
 
+#include "engine.h"
 #include "../utils/file_info.h"
+#include "../utils/metrics.h"
 #include "../utils/swarm.h"
+#include "../utils/store.h"
 
+#include <deque>
 #include <string>
 #include <unordered_map>
 
+#define UPLOAD_IDLE_US 50 // Pause of the upload thread when no request is pending
+
+struct pendingrequest {
+    int source;                 // Client waiting for the reply
+    segmentrequest request;     // Requested file and segment
+    bool cancelled;             // Withdrawn by the client before being served
+};
+
 /**
  * @brief Handle shutdown signal from the coordinator
  */
 void shutdown_upload(void);
 
+/**
+ * @brief Moves every segment request and cancel delivered by the engine into the upload queue
+ * 
+ * @param queue Requests received but not served yet
+ * @return True if at least one message was taken from the inbox
+ */
+bool receive_segment_messages(std::deque<pendingrequest>& queue);
+
 /**
  * @brief Respond to segment request from clients
+ * 
+ * @param store Local segment store shared with the download thread
+ * @param pending Request taken out of the upload queue
+ * @param stats Upload statistics, written by the upload thread only
  */
-void segment_request_response(void);
+void segment_request_response(localstore& store, const pendingrequest& pending, peerstats& stats);
 
 /**
  * @brief Thread function to handle upload tasks
  * 
- * @param files Map containing file hashes segments
+ * @param engine Communication engine of the client
+ * @param store Local segment store shared with the download thread
+ * @param stats Upload statistics, written by the upload thread only
  * @param rank Rank of the current MPI process
  */
-void upload_thread(
-    std::unordered_map<std::string, hashes> files, int rank);
+void upload_thread(commengine& engine, localstore& store, peerstats& stats, int rank);
 
 #endif // UPLOAD_CLIENTS_H
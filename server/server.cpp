@@ -1,161 +1,588 @@
 #include "server.h"
+#include "../utils/logger.h"
+
 #include <mpi.h>
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
 
 using namespace std;
 
 static MPI_Status status;
 static char recvMsg;
 
+struct segmentlocation {
+    string file;                // File owning the hash
+    int segment;                // Index of the hash in the file
+};
+
+static unordered_map<string, vector<segmentlocation>> segmentIndex;   // Locations of every hash, by content
+static unordered_map<string, unordered_set<string>> sharedFiles;      // Files sharing a hash, their aliases depend on each other
+
+struct pendingreply {
+    MPI_Request request;                        // Nonblocking send of the reply
+    shared_ptr<const vector<char>> buffer;      // Encoded reply, kept alive until the send completed
+};
+
+static list<pendingreply> pendingReplies;       // Swarm replies still in flight
+static int replyEncodes = 0;                    // Swarm replies built
+static int replyHits = 0;                       // Swarm replies served from the cache
+static double trackerStart;                     // Time the tracker started serving queries (MPI_Wtime)
+
 /**
- * @brief Receive the number of files from a client.
+ * @brief Unpacks the owned files of a client manifest into the database.
  *
  * @param cIdx The index of the client.
- * @param fileNo Reference to store the number of files received.
+ * @param cursor Reference to the read position inside the manifest, moved past the owned files.
+ * @param ownedNo Number of owned files in the manifest.
+ * @param database Reference to the unordered map storing file information.
  */
-static void recv_file_no(int cIdx, int& fileNo) {
-    if (MPI_Recv(&fileNo, 1, MPI_INT, cIdx, 1, MPI_COMM_WORLD, &status) != MPI_SUCCESS) {
-        cerr << "[ERROR]: receiving file number from client " << cIdx << "\n";
+static void unpack_owned_files(int cIdx, const char*& cursor, int ownedNo,
+    unordered_map<string, trackedfile>& database) {
+
+    for (int fIdx = 0; fIdx < ownedNo; ++fIdx) {
+        manifestfile entry;
+        memcpy(&entry, cursor, sizeof(manifestfile));
+        cursor += sizeof(manifestfile);
+        entry.fileName[MAX_FILENAME - 1] = '\0';
+
+        trackedfile& swarm = database[entry.fileName];
+        if (swarm.segments.empty()) {
+            // First seed of the file provides the hashes
+            swarm.segmentsNo = entry.hashesNo;
+            swarm.segments.reserve(entry.hashesNo);
+            for (int sIdx = 0; sIdx < entry.hashesNo; ++sIdx) {
+                char *hash = (char *) malloc(sizeof(char) * HASH_SIZE);
+                memcpy(hash, cursor + sIdx * HASH_SIZE, HASH_SIZE);
+                swarm.segments.push_back(hash);
+            }
+        } else if (swarm.segmentsNo != entry.hashesNo) {
+            LOG_WARN("manifest_mismatch", cIdx, entry.fileName, entry.hashesNo, swarm.segmentsNo);
+        }
+        cursor += entry.hashesNo * HASH_SIZE;
+
+        // Every seed of the file is kept as a provider
+        client clientDetails = {cIdx, SEED, 0, swarm.segmentsNo};
+        swarm.providers.push_back(clientDetails);
+        swarm.seeds.push_back(cIdx);
     }
 }
 
 /**
- * @brief Receive the file name from a client.
+ * @brief Indexes the segments of every file by content, hashes are known once the manifests are in.
  *
- * @param cIdx The index of the client.
- * @param fileName Pointer to store the received file name.
+ * @param database Reference to the unordered map storing file information.
  */
-static void recv_file_name(int cIdx, char* fileName) {
-    if (MPI_Recv(fileName, MAX_FILENAME, MPI_CHAR, cIdx, 1, MPI_COMM_WORLD, &status) != MPI_SUCCESS) {
-        cerr << "[ERROR]: receiving filename from client " << cIdx << "\n";
+static void index_segments(const unordered_map<string, trackedfile>& database) {
+    for (const auto& [fileName, swarm] : database) {
+        for (int sIdx = 0; sIdx < swarm.segmentsNo; ++sIdx) {
+            segmentIndex[string(swarm.segments[sIdx], HASH_SIZE)].push_back({fileName, sIdx});
+        }
+    }
+
+    for (const auto& [digest, locations] : segmentIndex) {
+        for (const auto& location : locations) {
+            for (const auto& other : locations) {
+                if (other.file != location.file) {
+                    sharedFiles[location.file].insert(other.file);
+                }
+            }
+        }
     }
+    LOG_DEBUG("segment_index", LOG_NONE, nullptr, LOG_NONE, (int) segmentIndex.size());
 }
 
 /**
- * @brief Receives client information including segments.
+ * @brief Lists the providers owning the segments of a file at another location.
  *
- * @param cIdx The index of the client.
- * @param swarm Reference to the trackedfile object to store client information.
+ * @param database Reference to the unordered map storing file information.
+ * @param fileName Name of the requested file.
+ * @return Up to MAX_ALIASES providers per segment.
  */
-static void recv_segments_file(int cIdx, trackedfile& swarm) {
-    if (MPI_Recv(&swarm.segmentsNo, 1, MPI_INT, cIdx, 1, MPI_COMM_WORLD, &status) != MPI_SUCCESS) {
-        cerr << "[ERROR]: receiving segmentsNo from client " << cIdx << endl;
-    }
-
-    // Efficiently reserve space for known quantities
-    swarm.providers.reserve(swarm.providers.size() + 1);
-    swarm.segments.reserve(swarm.segmentsNo);
+static vector<segmentalias> find_aliases(const unordered_map<string, trackedfile>& database,
+    const string& fileName) {
 
-    client clientDetails = {cIdx, SEED, 0, swarm.segmentsNo};
-    swarm.providers.push_back(clientDetails);
+    vector<segmentalias> aliases;
+    const trackedfile& swarm = database.at(fileName);
 
     for (int sIdx = 0; sIdx < swarm.segmentsNo; ++sIdx) {
-        char *hash = new char[HASH_SIZE];
-        if (MPI_Recv(hash, HASH_SIZE, MPI_CHAR, cIdx, 1, MPI_COMM_WORLD, &status) != MPI_SUCCESS) {
-            cerr << "[ERROR]: receiving segment hash from client " << cIdx << "\n";
+        auto locations = segmentIndex.find(string(swarm.segments[sIdx], HASH_SIZE));
+        if (locations == segmentIndex.end()) {
             continue;
         }
-        swarm.segments.push_back(hash);
+
+        int found = 0;
+        for (const auto& location : locations->second) {
+            if (location.file == fileName && location.segment == sIdx) {
+                continue;
+            }
+            for (const auto& provider : database.at(location.file).providers) {
+                if (found < MAX_ALIASES && provider.interval.first <= location.segment
+                    && provider.interval.last > location.segment) {
+                    aliases.push_back({sIdx, provider.id});
+                    found++;
+                }
+            }
+        }
     }
+    return aliases;
 }
 
 /**
- * @brief Broadcasts shutdown signal to all clients.
+ * @brief Broadcasts shutdown signal to all clients with a nonblocking collective.
+ * Every upload thread has the matching broadcast posted since it started.
  *
  * @param numtasks Total number of tasks including the tracker.
  */
 void shutdown(int numtasks) {
     char close = FIN; // Broadcast confirmation to clients
-    for (int cIdx = 1; cIdx < numtasks; ++cIdx) {
-        MPI_Send(&close, 1, MPI_CHAR, cIdx, 0, MPI_COMM_WORLD);
+    MPI_Request request;
+
+    MPI_Ibcast(&close, 1, MPI_CHAR, TRACKER_RANK, MPI_COMM_WORLD, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    LOG_DEBUG("shutdown", LOG_NONE, nullptr, LOG_NONE, numtasks - 1);
+}
+
+/**
+ * @brief Broadcasts confirmation signal and run configuration to all clients.
+ *
+ * @param config Reference to the configuration, its status is set to ACK.
+ */
+void confirmation(swarmconfig& config) {
+    config.status = ACK; // Broadcast confirmation to clients
+    MPI_Bcast(&config, sizeof(swarmconfig), MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
+}
+
+/**
+ * @brief Packs the swarm data of a file in the layout of a single swarm reply.
+ *
+ * @param swarm Reference to the trackedfile object containing swarm data.
+ * @param aliases Providers of the same hashes at other locations.
+ * @return The encoded reply.
+ */
+shared_ptr<const vector<char>> encode_swarm(const trackedfile& swarm, const vector<segmentalias>& aliases) {
+    swarmheader header = {(int) swarm.providers.size(), swarm.segmentsNo, (int) aliases.size()};
+
+    // Header, providers and hash segments travel in a single message
+    auto reply = make_shared<vector<char>>(sizeof(swarmheader) + header.providersNo * sizeof(client)
+        + header.segmentsNo * HASH_SIZE + header.aliasesNo * sizeof(segmentalias));
+    char* cursor = reply->data();
+    memcpy(cursor, &header, sizeof(swarmheader));
+    cursor += sizeof(swarmheader);
+    memcpy(cursor, swarm.providers.data(), header.providersNo * sizeof(client));
+    cursor += header.providersNo * sizeof(client);
+    for (int sIdx = 0; sIdx < swarm.segmentsNo; ++sIdx) {
+        memcpy(cursor, swarm.segments[sIdx], HASH_SIZE);
+        cursor += HASH_SIZE;
     }
+    memcpy(cursor, aliases.data(), header.aliasesNo * sizeof(segmentalias));
+
+    replyEncodes++;
+    return reply;
 }
 
 /**
- * @brief Broadcasts confirmation signal to all clients.
+ * @brief Sends an encoded swarm reply to a client with a nonblocking send.
  *
- * @param numtasks Total number of tasks including the tracker.
+ * @param reply The encoded reply, shared with the other pending sends.
+ * @param rank The index of the client receiving the swarm data.
  */
-void confirmation(int numtasks) {
-    char load = ACK; // Broadcast confirmation to clients
-    for (int cIdx = 1; cIdx < numtasks; ++cIdx) {
-        MPI_Send(&load, 1, MPI_CHAR, cIdx, 1, MPI_COMM_WORLD);
+void send_data_to(const shared_ptr<const vector<char>>& reply, int rank) {
+    LOG_DEBUG("swarm_reply", rank, nullptr, LOG_NONE, (int) reply->size());
+
+    pendingReplies.push_back({MPI_REQUEST_NULL, reply});
+    pendingreply& pending = pendingReplies.back();
+    MPI_Isend(pending.buffer->data(), pending.buffer->size(), MPI_BYTE, rank, TAG_SWARM_REPLY,
+        MPI_COMM_WORLD, &pending.request);
+}
+
+/**
+ * @brief Releases the replies whose send completed.
+ *
+ * @param wait Block until every pending send completed.
+ */
+static void reap_replies(bool wait) {
+    for (auto it = pendingReplies.begin(); it != pendingReplies.end();) {
+        int done = 0;
+        if (wait) {
+            MPI_Wait(&it->request, MPI_STATUS_IGNORE);
+            done = 1;
+        } else {
+            MPI_Test(&it->request, &done, MPI_STATUS_IGNORE);
+        }
+        it = done ? pendingReplies.erase(it) : next(it);
     }
 }
 
 /**
- * @brief Receives data from clients regarding the number of leechers and files.
+ * @brief Finds the position of a client among the providers of a file, through its cached slot.
  *
- * @param numtasks Total number of tasks including the tracker.
- * @param leechersNo Reference to store the number of leechers.
- * @param filesNo Reference to store the number of files.
+ * @param swarm Reference to the tracked file.
+ * @param cIdx The index of the client.
+ * @return The position of the client, the number of providers if it provides nothing yet.
  */
-void recv_data_from(int numtasks, int& leechersNo, int& filesNo) {
-    leechersNo = numtasks - 1;
-    for (int cIdx = 1; cIdx < numtasks; ++cIdx) {
-        MPI_Recv(&filesNo, 1, MPI_INT, cIdx, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        if (filesNo == 0) {
-            leechersNo--;
+static int find_provider(trackedfile& swarm, int cIdx) {
+    // Cached position of the client, checked before use and searched again when stale
+    if ((int) swarm.providerSlot.size() <= cIdx) {
+        swarm.providerSlot.resize(cIdx + 1, -1);
+    }
+    int& slot = swarm.providerSlot[cIdx];
+    if (slot < 0 || slot >= (int) swarm.providers.size() || swarm.providers[slot].id != cIdx) {
+        slot = 0;
+        while (slot < (int) swarm.providers.size() && swarm.providers[slot].id != cIdx) {
+            ++slot;
         }
     }
+    return slot;
 }
 
 /**
- * @brief Sends swarm data to a client.
+ * @brief Checks whether a client owns a segment through the prefix it reported.
  *
- * @param swarm Reference to the trackedfile object containing swarm data.
- * @param rank The index of the client receiving the swarm data.
+ * @param swarm Reference to the tracked file.
+ * @param cIdx The index of the client.
+ * @param segment Index of the segment.
+ * @return True if the segment is inside the interval of the client.
  */
-void send_data_to(const trackedfile& swarm, int rank) {
-    int providers = swarm.providers.size();
-    cout << "\n\n Send request to client: " << rank << "\n";
+static bool in_prefix(trackedfile& swarm, int cIdx, int segment) {
+    int slot = find_provider(swarm, cIdx);
+    return slot < (int) swarm.providers.size() && swarm.providers[slot].interval.first <= segment
+        && swarm.providers[slot].interval.last > segment;
+}
 
-    MPI_Send(&providers, 1, MPI_INT, rank, 1, MPI_COMM_WORLD);
-    MPI_Send(&swarm.segmentsNo, 1, MPI_INT, rank, 1, MPI_COMM_WORLD);
-    MPI_Send(swarm.providers.data(), providers * sizeof(client), MPI_BYTE, rank, 1, MPI_COMM_WORLD);
-    
-    // Send hash segments
+/**
+ * @brief Counts the clients holding every segment of a file, initial seeds excluded.
+ *
+ * @param swarm Reference to the tracked file.
+ * @return The number of holders of every segment.
+ */
+static vector<int> count_holders(trackedfile& swarm) {
+    // Intervals are added to a difference array, then summed
+    vector<int> holders(swarm.segmentsNo + 1, 0);
+    for (const auto& provider : swarm.providers) {
+        if (find(swarm.seeds.begin(), swarm.seeds.end(), provider.id) == swarm.seeds.end()) {
+            holders[provider.interval.first]++;
+            holders[provider.interval.last]--;
+        }
+    }
+    for (int sIdx = 1; sIdx <= swarm.segmentsNo; ++sIdx) {
+        holders[sIdx] += holders[sIdx - 1];
+    }
+    holders.pop_back();
+
+    for (const auto& piece : swarm.pieces) {
+        if (!in_prefix(swarm, piece.provider, piece.segment)) {
+            holders[piece.segment]++;
+        }
+    }
+    return holders;
+}
+
+/**
+ * @brief Gets the encoded swarm reply of a file, built again only if the providers changed.
+ *
+ * @param database Reference to the unordered map storing file information.
+ * @param fileName Name of the requested file.
+ * @return The encoded reply.
+ */
+static shared_ptr<const vector<char>> cached_reply(unordered_map<string, trackedfile>& database,
+    const string& fileName) {
+
+    trackedfile& swarm = database.at(fileName);
+    if (swarm.reply) {
+        replyHits++;
+        return swarm.reply;
+    }
+
+    // Offered segments held beyond a prefix are only reachable through their holder
+    vector<segmentalias> aliases = find_aliases(database, fileName);
+    for (const auto& piece : swarm.pieces) {
+        if (!in_prefix(swarm, piece.provider, piece.segment)) {
+            aliases.push_back(piece);
+        }
+    }
+
+    swarm.reply = encode_swarm(swarm, aliases);
+    LOG_DEBUG("swarm_encode", LOG_NONE, fileName.c_str(), LOG_NONE, swarm.version);
+    return swarm.reply;
+}
+
+/**
+ * @brief Drops the cached reply of a file whose providers changed, and of the files
+ * sharing its hashes since their aliases list the same providers.
+ *
+ * @param database Reference to the unordered map storing file information.
+ * @param fileName Name of the updated file.
+ */
+static void invalidate_reply(unordered_map<string, trackedfile>& database, const string& fileName) {
+    database.at(fileName).reply.reset();
+
+    auto shared = sharedFiles.find(fileName);
+    if (shared == sharedFiles.end()) {
+        return;
+    }
+    for (const auto& other : shared->second) {
+        database.at(other).reply.reset();
+    }
+}
+
+/**
+ * @brief Applies the progress of one client for one file to the database.
+ *
+ * @param swarm Reference to the tracked file the progress refers to.
+ * @param leechers Reference to the number of leechers still downloading the file.
+ * @param cIdx The index of the client reporting the progress.
+ * @param segmentLast Number of segments owned by the client, counted from the first one.
+ * @return True if the providers changed.
+ */
+bool apply_progress(trackedfile& swarm, int& leechers, int cIdx, int segmentLast) {
+    if (segmentLast <= 0 || segmentLast > swarm.segmentsNo) {
+        return false;
+    }
+
+    auto it = swarm.providers.begin() + find_provider(swarm, cIdx);
+
+    if (it == swarm.providers.end()) {
+        // Add new peer, it can serve everything it reported so far
+        client peer = {cIdx, PEER, 0, segmentLast};
+        swarm.providers.push_back(peer);
+        it = swarm.providers.end() - 1;
+    } else if (segmentLast > it->interval.last) {
+        // Update the last segment for the client
+        it->interval.last = segmentLast;
+    } else {
+        return false;
+    }
+
+    if (it->interval.last == swarm.segmentsNo && it->type != SEED) {
+        // Client becomes a seed
+        it->type = SEED;
+        leechers--;
+    }
+    swarm.version++;
+    return true;
+}
+
+/**
+ * @brief Records offered segments a client owns beyond its prefix.
+ *
+ * @param swarm Reference to the tracked file the segments belong to.
+ * @param cIdx The index of the client reporting the segments.
+ * @param offered The offered segments, empty if none.
+ * @return True if one of the segments was not known to be held by the client.
+ */
+bool apply_piece(trackedfile& swarm, int cIdx, hashrange offered) {
+    bool changed = false;
+
+    for (int sIdx = max(offered.first, 0); sIdx < min(offered.last, swarm.segmentsNo); ++sIdx) {
+        if (in_prefix(swarm, cIdx, sIdx)) {
+            continue;
+        }
+        bool known = false;
+        for (const auto& piece : swarm.pieces) {
+            known |= piece.segment == sIdx && piece.provider == cIdx;
+        }
+        if (!known) {
+            swarm.pieces.push_back({sIdx, cIdx});
+            changed = true;
+        }
+    }
+
+    swarm.version += changed;
+    return changed;
+}
+
+/**
+ * @brief Picks the segments a super seed advertises to a leecher.
+ *
+ * @param swarm Reference to the tracked file.
+ * @param cIdx The index of the leecher asking for the swarm.
+ * @param block Most segments in one offer.
+ * @return The offered segments and their super seed, id -1 if none.
+ */
+client super_offer(trackedfile& swarm, int cIdx, int block) {
+    client none = {-1, SEED, 0, 0};
+    int slot = find_provider(swarm, cIdx);
+    if (swarm.superSeeds.empty() || (slot < (int) swarm.providers.size() && swarm.providers[slot].type == SEED)) {
+        return none;
+    }
+    vector<int> holders = count_holders(swarm);
+
+    // An offer stands until another client holds all of it too, or the leecher asked too many times
+    for (auto it = swarm.offers.begin(); it != swarm.offers.end();) {
+        int rarest = *min_element(holders.begin() + it->interval.first, holders.begin() + it->interval.last);
+        bool reshared = rarest >= 2;
+        if (it->leecher == cIdx && !reshared && ++it->asks < SUPER_SEED_PATIENCE) {
+            return {it->provider, SEED, it->interval};
+        }
+        it = (it->leecher == cIdx || reshared) ? swarm.offers.erase(it) : next(it);
+    }
+
+    // Segments nobody holds yet and nobody else was offered, the lowest ones first
+    vector<char> excluded(swarm.segmentsNo, 0);
+    for (const auto& offer : swarm.offers) {
+        fill(excluded.begin() + offer.interval.first, excluded.begin() + offer.interval.last, 1);
+    }
     for (int sIdx = 0; sIdx < swarm.segmentsNo; ++sIdx) {
-        MPI_Send(swarm.segments[sIdx], HASH_SIZE, MPI_CHAR, rank, 1, MPI_COMM_WORLD);
+        excluded[sIdx] |= holders[sIdx] > 0 || in_prefix(swarm, cIdx, sIdx);
+    }
+
+    auto first = find(excluded.begin(), excluded.end(), 0);
+    if (first == excluded.end()) {
+        return none;
+    }
+    auto last = find(first, first + min<long>(block, excluded.end() - first), 1);
+
+    superoffer offer = {cIdx, swarm.superSeeds[swarm.offers.size() % swarm.superSeeds.size()],
+        (int) (first - excluded.begin()), (int) (last - excluded.begin()), 0};
+    swarm.offers.push_back(offer);
+    LOG_DEBUG("super_offer", cIdx, nullptr, offer.interval.first, offer.interval.last);
+    return {offer.provider, SEED, offer.interval};
+}
+
+/**
+ * @brief Records the time a full copy of a file was first spread over the other clients,
+ * then lists its super seeds as regular providers again.
+ *
+ * @param swarm Reference to the tracked file.
+ * @param now Current time.
+ * @return True the first time every segment is held by a client other than the initial seeds.
+ */
+bool mark_distributed(trackedfile& swarm, double now) {
+    if (swarm.distributed >= 0 || swarm.segmentsNo == 0) {
+        return false;
+    }
+    vector<int> holders = count_holders(swarm);
+    if (find(holders.begin(), holders.end(), 0) != holders.end()) {
+        return false;
+    }
+
+    // Leechers now hold every segment between them, the seeds help with the rest
+    swarm.distributed = now;
+    for (int seed : swarm.superSeeds) {
+        swarm.providers.push_back({seed, SEED, 0, swarm.segmentsNo});
+    }
+    swarm.superSeeds.clear();
+    swarm.offers.clear();
+    swarm.version++;
+    return true;
+}
+
+/**
+ * @brief Hides the initial seeds of every file, they are only reached through their offers.
+ *
+ * @param database Reference to the unordered map storing file information.
+ */
+static void hide_seeds(unordered_map<string, trackedfile>& database) {
+    for (auto& [fileName, swarm] : database) {
+        swarm.superSeeds = swarm.seeds;
+        swarm.providers.erase(remove_if(swarm.providers.begin(), swarm.providers.end(),
+            [&swarm](const client& provider) {
+                return find(swarm.seeds.begin(), swarm.seeds.end(), provider.id) != swarm.seeds.end();
+            }), swarm.providers.end());
+        LOG_DEBUG("super_seeds", LOG_NONE, fileName.c_str(), LOG_NONE, (int) swarm.superSeeds.size());
+    }
+}
+
+/**
+ * @brief Packs the offer made to a requester, sent after the shared swarm reply.
+ *
+ * @param offer The segments offered to the requester, id -1 if none.
+ * @return The encoded offer.
+ */
+static shared_ptr<const vector<char>> encode_offer(const client& offer) {
+    auto reply = make_shared<vector<char>>(sizeof(client));
+    memcpy(reply->data(), &offer, sizeof(client));
+    return reply;
+}
+
+/**
+ * @brief Logs the time at which a full copy of a file was first spread over the leechers.
+ *
+ * @param swarm Reference to the tracked file.
+ * @param fileName Name of the file.
+ */
+static void record_distribution(trackedfile& swarm, const string& fileName) {
+    if (!mark_distributed(swarm, MPI_Wtime() - trackerStart)) {
+        return;
     }
+    LOG_INFO("distributed_copy_us", LOG_NONE, fileName.c_str(), LOG_NONE, (int) (swarm.distributed * 1e6));
 }
 
 /**
- * @brief Receives data from clients and updates the database with file information.
+ * @brief Gathers the manifests of all clients and updates the database with file information.
  *
  * @param numtasks Total number of tasks including the tracker.
  * @param database Reference to the unordered map storing file information.
  * @param leechersFiles Reference to the unordered map storing the number of leechers for each file.
+ * @param leechersNo Reference to store the number of clients that want at least one file.
  */
 void update_request(int numtasks,
     unordered_map<string, trackedfile>& database,
-    unordered_map<string, int>& leechersFiles) {
+    unordered_map<string, int>& leechersFiles, int& leechersNo) {
 
-    int fileNo = 0;
-    char fileCName[MAX_FILENAME];
+    // Manifest sizes first, then every manifest in a single collective
+    vector<int> sizes(numtasks, 0), displs(numtasks, 0);
+    int emptySize = 0;
+    MPI_Gather(&emptySize, 1, MPI_INT, sizes.data(), 1, MPI_INT, TRACKER_RANK, MPI_COMM_WORLD);
 
     for (int cIdx = 1; cIdx < numtasks; ++cIdx) {
-        // Receive file number
-        recv_file_no(cIdx, fileNo);
-
-        for (int fIdx = 0; fIdx < fileNo; ++fIdx) {
-            // Receive file name
-            recv_file_name(cIdx, fileCName);
-            string fileName(fileCName);
-            // Receive client information
-            trackedfile swarm;
-            recv_segments_file(cIdx, swarm);
-
-            // Update database
-            database[fileName] = swarm;
-            // Ensures a new file entry or an update to an existing one
-            leechersFiles[fileName] = 0;
+        displs[cIdx] = displs[cIdx - 1] + sizes[cIdx - 1];
+    }
+    vector<char> manifests(displs[numtasks - 1] + sizes[numtasks - 1]);
+    vector<pair<int, progressentry>> resumed;
+    MPI_Gatherv(nullptr, 0, MPI_BYTE, manifests.data(), sizes.data(), displs.data(),
+        MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
+
+    leechersNo = 0;
+    for (int cIdx = 1; cIdx < numtasks; ++cIdx) {
+        if (sizes[cIdx] < (int) sizeof(manifestheader)) {
+            LOG_ERROR("manifest_truncated", cIdx, nullptr, LOG_NONE, sizes[cIdx]);
+            continue;
+        }
+
+        const char* cursor = manifests.data() + displs[cIdx];
+        manifestheader header;
+        memcpy(&header, cursor, sizeof(manifestheader));
+        cursor += sizeof(manifestheader);
+
+        unpack_owned_files(cIdx, cursor, header.ownedNo, database);
+
+        // Count the leechers of every wanted file
+        char fileCName[MAX_FILENAME];
+        for (int fIdx = 0; fIdx < header.wantedNo; ++fIdx) {
+            memcpy(fileCName, cursor, MAX_FILENAME);
+            fileCName[MAX_FILENAME - 1] = '\0';
+            cursor += MAX_FILENAME;
+            leechersFiles[fileCName]++;
+        }
+        if (header.wantedNo > 0) {
+            leechersNo++;
+        }
+
+        // Partial downloads resumed from a checkpoint, applied once every seed is known
+        for (int fIdx = 0; fIdx < header.resumedNo; ++fIdx) {
+            progressentry entry;
+            memcpy(&entry, cursor, sizeof(progressentry));
+            cursor += sizeof(progressentry);
+            entry.fileName[MAX_FILENAME - 1] = '\0';
+            resumed.push_back({cIdx, entry});
         }
     }
+
+    for (const auto& [cIdx, entry] : resumed) {
+        auto file = database.find(entry.fileName);
+        if (file == database.end()) {
+            LOG_WARN("resume_unknown_file", cIdx, entry.fileName, entry.segmentLast, LOG_NONE);
+            continue;
+        }
+        apply_progress(file->second, leechersFiles[file->first], cIdx, entry.segmentLast);
+        LOG_INFO("resume", cIdx, entry.fileName, entry.segmentLast, file->second.segmentsNo);
+    }
 }
 
 /**
- * @brief Receives the finished downloading signal from a client and updates the database accordingly.
+ * @brief Receives a batch of progress updates from a client and applies it to the database.
  *
  * @param database Reference to the unordered map storing file information.
  * @param leechersFiles Reference to the unordered map storing the number of leechers for each file.
@@ -164,52 +591,37 @@ void update_databe(
     unordered_map<string, trackedfile>& database,
     unordered_map<string, int>& leechersFiles) {
 
-    char fileCName[MAX_FILENAME];
-    int segmentLast;
-
-    // Client finished downloading
-    MPI_Recv(fileCName, MAX_FILENAME, MPI_CHAR, status.MPI_SOURCE, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(&segmentLast, 1, MPI_INT, status.MPI_SOURCE, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    string fileName(fileCName);
-    if (segmentLast == 10) {
-        // Add new seed
-        client seeder;
-        seeder.id = status.MPI_SOURCE;
-        seeder.interval.first = 10;
-        seeder.interval.last = 0;
-        seeder.type = PEER;
-        database[fileName].providers.push_back(seeder);
-    } else if (segmentLast < database[fileName].segmentsNo && segmentLast > 10) {
-        // Update the last segment for the client
-        for (auto& it : database[fileName].providers) {
-            if (it.id == status.MPI_SOURCE) {
-                it.interval.last = segmentLast;
-            }
-        }
-    } else if (segmentLast == database[fileName].segmentsNo) {
-        // Client becomes a seed
-        leechersFiles[fileName]--;
-        for (auto& it : database[fileName].providers) {
-            if (it.id == status.MPI_SOURCE) {
-                it.interval.last = segmentLast;
-                it.type = SEED;
-            }
+    int bytes = 0;
+    MPI_Get_count(&status, MPI_BYTE, &bytes);
+
+    // One message carries the coalesced progress of every file of the client
+    vector<progressentry> batch(bytes / sizeof(progressentry));
+    MPI_Recv(batch.data(), bytes, MPI_BYTE, status.MPI_SOURCE, TAG_PROGRESS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    for (auto& entry : batch) {
+        entry.fileName[MAX_FILENAME - 1] = '\0';
+        auto file = database.find(entry.fileName);
+        if (file == database.end()) {
+            LOG_WARN("progress_unknown_file", status.MPI_SOURCE, entry.fileName, entry.segmentLast, LOG_NONE);
+            continue;
         }
-    }
 
-    // Logging for debugging purposes
-    cout << fileName
-         << " client " << status.MPI_SOURCE << "\n"
-         << "last hash segment " << segmentLast
-         << " total " << database[fileName].segmentsNo << "\n";
+        bool changed = apply_progress(file->second, leechersFiles[file->first], status.MPI_SOURCE, entry.segmentLast);
+        changed = apply_piece(file->second, status.MPI_SOURCE, entry.offered) || changed;
+        if (changed) {
+            // The first distributed copy may reveal super seeds, the reply is rebuilt after it
+            record_distribution(file->second, file->first);
+            invalidate_reply(database, file->first);
+        }
+        LOG_DEBUG("progress", status.MPI_SOURCE, entry.fileName, entry.segmentLast, file->second.segmentsNo);
 
-    for (const auto& it : database[fileName].providers) {
-        cout << "client id: " << it.id << "\n"
-             << "last hash segment: " << it.interval.last << "\n"
-             << "client type: " << it.type << "\n";
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+        // Provider dump only exists in tracing builds
+        for (const auto& it : file->second.providers) {
+            LOG_TRACE("provider", it.id, entry.fileName, it.interval.last, it.type);
+        }
+#endif
     }
-    cout << "\n\n";
 }
 
 /**
@@ -223,45 +635,92 @@ void tracker(int numtasks, int rank) {
     unordered_map<string, trackedfile> database;
     unordered_map<string, int> leechersFiles;
     
-    int inSwarm = 0, filesNo = -1, leechersNo = numtasks - 1;
+    int inSwarm = 0, leechersNo = numtasks - 1;
     char fileCName[MAX_FILENAME];
+    swarmconfig config = load_config();
 
     // Initial data gathering and confirmation
-    update_request(numtasks, database, leechersFiles);
-    confirmation(numtasks);
-    recv_data_from(numtasks, leechersNo, filesNo);
+    update_request(numtasks, database, leechersFiles, leechersNo);
+    index_segments(database);
+    if (config.superSeed) {
+        hide_seeds(database);
+    }
+    confirmation(config);
+
+    // Every client places the segments of a file at the same slots of its window
+    segmentwindow window;
+    filecatalog catalog;
+    memset(&catalog, 0, sizeof(filecatalog));
+    for (const auto& file : database) {
+        if (catalog.filesNo == MAX_CATALOG) {
+            LOG_WARN("catalog_full", LOG_NONE, file.first.c_str(), LOG_NONE, MAX_CATALOG);
+            break;
+        }
+        strncpy(catalog.fileNames[catalog.filesNo++], file.first.c_str(), MAX_FILENAME - 1);
+    }
+    window_setup(window, catalog, config, numtasks, rank);
+
+    auto unknownReply = encode_swarm(trackedfile(), vector<segmentalias>());
+    trackerStart = MPI_Wtime();
 
     // Loop until all leechers have finished downloading
     while (inSwarm < leechersNo) {
-        memset(fileCName, 0, sizeof(char) * MAX_FILENAME);
-        // Receive file name from any client
-        MPI_Recv(fileCName, MAX_FILENAME, MPI_CHAR, MPI_ANY_SOURCE, 1, MPI_COMM_WORLD, &status);
-
-        string fileName(fileCName);
-        // Get swarm information for the file
-        trackedfile swarm = database[fileName];
-        // Send swarm information to the client
-        send_data_to(swarm, status.MPI_SOURCE);
-        // Process finished downloading message from the client
-        update_databe(database, leechersFiles);
-
-        // Handle finish message
-        cout << "Received request from: client" << status.MPI_SOURCE << "\n";
-        // Probe for incoming message
-        MPI_Probe(status.MPI_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        if (status.MPI_TAG == 0) {
-            // Receive finish confirmation from any source
-            MPI_Recv(&recvMsg, 1, MPI_CHAR, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
+        // Swarm queries, progress batches and finish messages are served independently
+        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        reap_replies(false);
+
+        if (status.MPI_TAG == TAG_SWARM_REQUEST) {
+            memset(fileCName, 0, sizeof(char) * MAX_FILENAME);
+            MPI_Recv(fileCName, MAX_FILENAME, MPI_CHAR, status.MPI_SOURCE, TAG_SWARM_REQUEST, MPI_COMM_WORLD, &status);
+            LOG_DEBUG("request", status.MPI_SOURCE, fileCName, LOG_NONE, LOG_NONE);
+
+            // Send swarm information to the client, unknown files have no segments
+            auto file = database.find(fileCName);
+            client offer = {-1, SEED, 0, 0};
+            if (file != database.end()) {
+                offer = super_offer(file->second, status.MPI_SOURCE, config.segmentBatch);
+                send_data_to(cached_reply(database, file->first), status.MPI_SOURCE);
+            } else {
+                send_data_to(unknownReply, status.MPI_SOURCE);
+            }
+            // Super seeds only show up in the offer, sent on its own so the reply stays shared
+            if (config.superSeed) {
+                send_data_to(encode_offer(offer), status.MPI_SOURCE);
+            }
+        } else if (status.MPI_TAG == TAG_PROGRESS) {
+            // Apply the batched progress of the client
+            update_databe(database, leechersFiles);
+        } else if (status.MPI_TAG == TAG_FIN) {
+            // Receive finish confirmation from the client
+            MPI_Recv(&recvMsg, 1, MPI_CHAR, status.MPI_SOURCE, TAG_FIN, MPI_COMM_WORLD, &status);
             // Check if it's a finish message
             if (recvMsg == FIN) {
                 inSwarm++;
             }
+            LOG_DEBUG("in_swarm", status.MPI_SOURCE, nullptr, LOG_NONE, inSwarm);
+        } else {
+            // Drop messages outside the protocol so the probe can move on
+            int bytes = 0;
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            vector<char> unexpected(bytes);
+            MPI_Recv(unexpected.data(), bytes, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            LOG_WARN("unexpected_tag", status.MPI_SOURCE, nullptr, LOG_NONE, status.MPI_TAG);
         }
-        cout << inSwarm << "  ||  " << numtasks << "\n";
     }
 
+    // Every reply is delivered before the clients are finalized
+    reap_replies(true);
+    LOG_INFO("swarm_reply_encodes", LOG_NONE, nullptr, LOG_NONE, replyEncodes);
+    LOG_INFO("swarm_reply_hits", LOG_NONE, nullptr, LOG_NONE, replyHits);
+
     // Finalize all clients
     shutdown(numtasks);
+    window_free(window);
+
+    // Collect and report the download statistics of every client
+    peerstats none;
+    memset(&none, 0, sizeof(peerstats));
+    gather_stats(none, numtasks, rank);
 
     // Free allocated memory
     for (auto& file : database) {
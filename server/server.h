@@ -5,8 +5,12 @@
 
 #include "../include/upload.h"
 #include "../include/download.h"
+#include "../utils/config.h"
+#include "../utils/window.h"
 
 #include <mpi.h>
+#include <list>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unistd.h>
@@ -22,33 +26,84 @@
 void tracker(int numtasks, int rank);
 
 /**
- * @brief Sends shutdown signal to all clients.
+ * @brief Sends shutdown signal to all clients with a nonblocking broadcast.
  *
  * @param numtasks Total number of tasks including the tracker.
  */
 void shutdown(int numtasks);
 
 /**
- * @brief Sends confirmation signal to all clients.
+ * @brief Broadcasts confirmation signal and run configuration to all clients.
  *
- * @param numtasks Total number of tasks including the tracker.
+ * @param config Reference to the configuration, its status is set to ACK.
  */
-void confirmation(int numtasks);
+void confirmation(swarmconfig& config);
 
 /**
- * @brief Receives data from clients and updates the database with file information.
+ * @brief Gathers the manifests of all clients (MPI_Gather of sizes, MPI_Gatherv of data)
+ * and updates the database with file information.
  *
  * @param numtasks Total number of tasks including the tracker.
  * @param database Reference to the unordered map storing file information.
  * @param leechersFiles Reference to the unordered map storing the number of leechers for each file.
+ * @param leechersNo Reference to store the number of clients that want at least one file.
  */
 void update_request(
     int numtasks,
     std::unordered_map<std::string, trackedfile>& database,
-    std::unordered_map<std::string, int>& leechersFiles);
+    std::unordered_map<std::string, int>& leechersFiles,
+    int& leechersNo);
+
+/**
+ * @brief Applies the progress of one client for one file to the database.
+ * The client becomes a provider of its owned prefix, then a seed once it owns every segment.
+ * Shared with the simulator, it does not communicate.
+ *
+ * @param swarm Reference to the tracked file the progress refers to.
+ * @param leechers Reference to the number of leechers still downloading the file.
+ * @param cIdx The index of the client reporting the progress.
+ * @param segmentLast Number of segments owned by the client, counted from the first one.
+ * @return True if the providers changed, the version of the swarm is bumped.
+ */
+bool apply_progress(trackedfile& swarm, int& leechers, int cIdx, int segmentLast);
+
+/**
+ * @brief Records the segments a client obtained from a super seed beyond its prefix, so the
+ * tracker advertises them as aliases and counts them as re-shared. Shared with the simulator.
+ *
+ * @param swarm Reference to the tracked file the segments belong to.
+ * @param cIdx The index of the client reporting the segments.
+ * @param offered The offered segments, empty if none.
+ * @return True if one of the segments was not known to be held by the client.
+ */
+bool apply_piece(trackedfile& swarm, int cIdx, hashrange offered);
+
+/**
+ * @brief Picks the segments the super seeds advertise to a leecher, the lowest run of segments
+ * nobody holds or was offered. The same offer is repeated until another client holds all of it
+ * as well, or for at most SUPER_SEED_PATIENCE swarm queries. Shared with the simulator.
+ *
+ * @param swarm Reference to the tracked file.
+ * @param cIdx The index of the leecher asking for the swarm.
+ * @param block Most segments in one offer.
+ * @return The offered segments and their super seed, id -1 if none.
+ */
+client super_offer(trackedfile& swarm, int cIdx, int block);
+
+/**
+ * @brief Records the time a full copy of a file was first spread over the clients other than
+ * its initial seeds. Super seeding ends there, the super seeds become regular providers again.
+ * Shared with the simulator.
+ *
+ * @param swarm Reference to the tracked file.
+ * @param now Current time.
+ * @return True the first time every segment is held by a client other than the initial seeds.
+ */
+bool mark_distributed(trackedfile& swarm, double now);
 
 /**
- * @brief Receives the finished downloading signal from a client and updates the database accordingly.
+ * @brief Receives a batch of progress updates from a client and applies it in bulk.
+ * A client becomes a provider with its first update and a seed once it owns every segment.
  *
  * @param database Reference to the unordered map storing file information.
  * @param leechersFiles Reference to the unordered map storing the number of leechers for each file.
@@ -59,21 +114,23 @@ void update_databe(
 
 
 /**
- * @brief Receives the number of leechers and files from each client.
+ * @brief Packs the swarm data of a file in the layout of a single swarm reply.
  *
- * @param numtasks Total number of tasks including the tracker.
- * @param leechersNo Reference to the variable storing the total number of leechers.
- * @param filesNo Reference to the variable storing the total number of files.
+ * @param swarm Reference to the trackedfile object containing swarm information
+ * (number of segments, segment hashes and providers).
+ * @param aliases Providers owning the same hashes in other files or at other indexes.
+ * @return The encoded reply, immutable once built.
  */
-void recv_data_from(int numtasks, int& leechersNo, int& filesNo);
+std::shared_ptr<const std::vector<char>> encode_swarm(const trackedfile& swarm,
+    const std::vector<segmentalias>& aliases);
 
 /**
- * @brief Sends data to a client.
+ * @brief Sends an encoded swarm reply to a client with a nonblocking send.
+ * The buffer is shared with the other pending sends and released once they completed.
  *
- * @param swarm Reference to the trackedfile object containing swarm information
- * (number of segments, segment hashes and providers).
- * @param rank Rank of the current task.
+ * @param reply The encoded reply.
+ * @param rank Rank of the client receiving the reply.
  */
-void send_data_to(const trackedfile& swarm, int rank);
+void send_data_to(const std::shared_ptr<const std::vector<char>>& reply, int rank);
 
 #endif // TRACKER_SERVER_H
@@ -1,35 +1,135 @@
 #include "../include/download.h"
+#include "../utils/logger.h"
 
-#include <mpi.h>
+#include <chrono>
+#include <deque>
 #include <thread>
 #include <fstream>
-#include <iostream>
+#include <cstring>
 #include <algorithm>
 #include <random>
 
 using namespace std;
 
 static char recvMsg;
+static commengine* comm;                // Engine of the client, owns every MPI call
+static deque<commmessage> stash;        // Replies received while waiting for another tag
+static bool offers;                     // Every swarm reply is followed by the offer of a super seed
 
 /**
- * @brief Sends file information to the coordinator.
+ * @brief Seconds on a monotonic clock, the download thread does not call MPI.
  * 
- * @param fileNo The number of files to send information for.
- * @param files Array of file names.
- * @param rank The rank of the current MPI task.
+ * @return The current time in seconds.
+ */
+static double now_seconds(void) {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Takes the next message with the given tag from the download inbox.
+ * 
+ * @param tag Wanted message tag.
+ * @return The oldest message with that tag.
  */
-void send_file_swarm(int fileNo, string* files, int rank) {
-    // Send the number of new files
-    MPI_Send(&fileNo, 1, MPI_INT, 0, 1, MPI_COMM_WORLD);
+static commmessage wait_message(int tag) {
+    for (auto it = stash.begin(); it != stash.end(); ++it) {
+        if (it->tag == tag) {
+            commmessage message = move(*it);
+            stash.erase(it);
+            return message;
+        }
+    }
 
+    while (true) {
+        commmessage message = engine_receive(comm->downloadInbox);
+        if (message.tag == tag) {
+            return message;
+        }
+        stash.push_back(move(message));
+    }
+}
+
+/**
+ * @brief Asks the coordinator for the current swarm of a file.
+ * 
+ * @param file Name of the file.
+ * @param segmentsNo Reference to store the number of providers.
+ * @param rank The rank of the current MPI task.
+ * @return The received file swarm information.
+ */
+trackedfile request_file_swarm(const string& file, int& segmentsNo, int rank) {
     char fileName[MAX_FILENAME];
+    memset(fileName, 0, sizeof(char) * MAX_FILENAME);
+    strncpy(fileName, file.c_str(), MAX_FILENAME - 1);
 
-    // Send all the fileNames needed
-    for (int fIdx = 0; fIdx < fileNo; ++fIdx) {
-        memset(fileName, 0, sizeof(char) * MAX_FILENAME);
-        strncpy(fileName, files[fIdx].c_str(), MAX_FILENAME);
-        MPI_Send(&fileName, MAX_FILENAME, MPI_CHAR, 0, 1, MPI_COMM_WORLD);
+    engine_send(*comm, TRACKER_RANK, TAG_SWARM_REQUEST, fileName, MAX_FILENAME);
+    return receive_file_swarm(segmentsNo, rank);
+}
+
+/**
+ * @brief Buffers the progress of a file, only the newest progress of a file is kept.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param file Name of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @param acquired Number of segments acquired since the previous record.
+ * @param offered Segments obtained from a super seed beyond segmentLast, empty if none.
+ */
+void record_progress(progressbatch& progress, const string& file, int segmentLast, int acquired, hashrange offered) {
+    progress.pendingSegments += acquired;
+
+    for (auto& entry : progress.entries) {
+        if (file == entry.fileName) {
+            // Coalesce with the pending entry of the same file
+            entry.segmentLast = segmentLast;
+            entry.offered = offered;
+            return;
+        }
     }
+
+    progressentry entry;
+    memset(entry.fileName, 0, sizeof(char) * MAX_FILENAME);
+    strncpy(entry.fileName, file.c_str(), MAX_FILENAME - 1);
+    entry.segmentLast = segmentLast;
+    entry.offered = offered;
+    progress.entries.push_back(entry);
+}
+
+/**
+ * @brief Tells whether the buffered progress has to be flushed.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param config Run configuration holding the flush thresholds.
+ * @param now Current time in seconds, on the clock of progress.lastFlush.
+ * @param force Flush even if neither the count nor the time threshold was reached.
+ * @return True if something is buffered and a threshold was reached or the flush is forced.
+ */
+bool progress_due(const progressbatch& progress, const swarmconfig& config, double now, bool force) {
+    bool due = progress.pendingSegments >= config.progressSegments
+            || (now - progress.lastFlush) * 1000 >= config.progressMs;
+    return !progress.entries.empty() && (force || due);
+}
+
+/**
+ * @brief Sends the buffered progress of every file to the coordinator in one message.
+ * 
+ * @param progress Reference to the pending progress batch.
+ * @param config Run configuration holding the flush thresholds.
+ * @param force Flush even if neither the count nor the time threshold was reached.
+ */
+void flush_progress(progressbatch& progress, const swarmconfig& config, bool force) {
+    double now = now_seconds();
+    if (!progress_due(progress, config, now, force)) {
+        return;
+    }
+
+    engine_send(*comm, TRACKER_RANK, TAG_PROGRESS, progress.entries.data(),
+        progress.entries.size() * sizeof(progressentry));
+    LOG_DEBUG("progress_flush", TRACKER_RANK, nullptr, LOG_NONE, progress.pendingSegments);
+
+    progress.entries.clear();
+    progress.pendingSegments = 0;
+    progress.lastFlush = now;
 }
 
 /**
@@ -41,64 +141,542 @@ void send_file_swarm(int fileNo, string* files, int rank) {
  */
 trackedfile receive_file_swarm(int& segmentsNo, int rank) {
     trackedfile swarm;
+    commmessage message = wait_message(TAG_SWARM_REPLY);
+    const char* cursor = message.payload.data();
 
     // Receive the number of members and the number of segments
-    MPI_Recv(&segmentsNo, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    MPI_Recv(&swarm.segmentsNo, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    swarmheader header;
+    memcpy(&header, cursor, sizeof(swarmheader));
+    cursor += sizeof(swarmheader);
+    segmentsNo = header.providersNo;
+    swarm.segmentsNo = header.segmentsNo;
 
-    // Resize the providers vector to accommodate the received number of members
+    // Copy the providers data directly into the vector
     swarm.providers.resize(segmentsNo);
+    memcpy(swarm.providers.data(), cursor, segmentsNo * sizeof(client));
+    cursor += segmentsNo * sizeof(client);
 
-    // Receive the providers data directly into the vector
-    MPI_Recv(swarm.providers.data(), segmentsNo * sizeof(client), MPI_BYTE, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    // Receive segment hashes and store them in the swarm
+    // Copy segment hashes and store them in the swarm
     for (int sidx = 0; sidx < swarm.segmentsNo; sidx++) {
-        char *hash = (char *) malloc(sizeof(char) * HASH_SIZE);
-        MPI_Recv(hash, HASH_SIZE, MPI_CHAR, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        char *hash = (char *) malloc(sizeof(char) * (HASH_SIZE + 1));
+        memcpy(hash, cursor, HASH_SIZE);
+        cursor += HASH_SIZE;
+        hash[HASH_SIZE] = '\0';
         swarm.segments.push_back(hash);
     }
 
+    // Providers of the same hashes in other files
+    swarm.aliases.resize(header.aliasesNo);
+    memcpy(swarm.aliases.data(), cursor, header.aliasesNo * sizeof(segmentalias));
+
+    // Segments a super seed offers to this client only, they follow the shared reply
+    if (offers) {
+        commmessage offerMessage = wait_message(TAG_SWARM_REPLY);
+        client offer;
+        memcpy(&offer, offerMessage.payload.data(), sizeof(client));
+        const hashrange& offered = offer.interval;
+        if (offer.id >= 0 && offered.first >= 0 && offered.first < offered.last && offered.last <= swarm.segmentsNo) {
+            swarm.offer = offer;
+        }
+    }
+
     return swarm;
 }
 
 /**
- * @brief Processes segments of a file.
+ * @brief Marks a verified segment as owned, stores it and appends it to the checkpoint.
+ * 
+ * @param file Name of the file.
+ * @param swarm Reference to the file swarm data.
+ * @param state Reference to the download state of the file.
+ * @param sIdx Index of the segment.
+ * @param hash Segment payload, HASH_SIZE characters.
+ * @param store Reference to the local segment store shared with the upload thread.
+ */
+static void own_segment(const string& file, trackedfile& swarm, filestate& state, int sIdx,
+    const char* hash, localstore& store) {
+
+    state.owned[sIdx] = 1;
+    store_segment(store, file, sIdx, swarm.segmentsNo, hash);
+    checkpoint_append(state.log, sIdx, hash);
+}
+
+/**
+ * @brief Marks as owned the segments restored from the checkpoint that match the swarm hashes.
+ * 
+ * @param file Name of the file.
+ * @param swarm Reference to the file swarm data, holds the expected hashes.
+ * @param state Reference to the download state of the file.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
+ */
+static void resume_segments(const string& file, trackedfile& swarm, filestate& state,
+    localstore& store, peerstats& stats) {
+
+    char hash[HASH_SIZE];
+
+    for (int sIdx = 0; sIdx < swarm.segmentsNo; ++sIdx) {
+        if (lookup_segment(store, file, sIdx, hash) && memcmp(hash, swarm.segments[sIdx], HASH_SIZE) == 0) {
+            state.owned[sIdx] = 1;
+            stats.resumedSegments++;
+        }
+    }
+}
+
+enum segmentverdict {
+    SEGMENT_ACCEPTED,       // First verified copy, stored
+    SEGMENT_DROPPED,        // Missing, cancelled or already owned
+    SEGMENT_CORRUPT         // Does not match the swarm hash
+};
+
+/**
+ * @brief Verifies a reply against the swarm hash and stores the segment.
+ * 
+ * @param file Name of the file.
+ * @param provider Client that served the reply.
+ * @param reply Reply received from the provider or read from its window.
+ * @param swarm Reference to the file swarm data, holds the expected hashes.
+ * @param state Reference to the download state of the file.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
+ * @return What was done with the reply.
+ */
+static segmentverdict accept_segment(const string& file, int provider, const segmentreply& reply,
+    trackedfile& swarm, filestate& state, localstore& store, peerstats& stats) {
+
+    int sIdx = reply.segment;
+
+    if (reply.status == SEGMENT_CANCELLED) {
+        stats.cancelledReplies++;
+        return SEGMENT_DROPPED;
+    }
+    if (reply.status != SEGMENT_OK || sIdx < 0 || sIdx >= swarm.segmentsNo) {
+        LOG_DEBUG("segment_missing", provider, file.c_str(), sIdx, reply.status);
+        return SEGMENT_DROPPED;
+    }
+    if (state.owned[sIdx]) {
+        // Endgame duplicate that was served before its cancel arrived
+        stats.redundantBytes += HASH_SIZE;
+        return SEGMENT_DROPPED;
+    }
+    if (memcmp(reply.hash, swarm.segments[sIdx], HASH_SIZE) != 0) {
+        LOG_WARN("segment_corrupt", provider, file.c_str(), sIdx, LOG_NONE);
+        return SEGMENT_CORRUPT;
+    }
+
+    own_segment(file, swarm, state, sIdx, reply.hash, store);
+    stats.segmentsFetched++;
+    return SEGMENT_ACCEPTED;
+}
+
+/**
+ * @brief Tells whether a window read has to be requested again by message.
+ * 
+ * @param reply Reply read from the window of the provider.
+ * @param verdict What accept_segment did with the reply.
+ * @return True if the slot was empty or failed verification.
+ */
+static bool window_missed(const segmentreply& reply, segmentverdict verdict) {
+    // An empty slot is not published yet, the upload thread answers for the store
+    return verdict == SEGMENT_CORRUPT || reply.status == SEGMENT_MISSING;
+}
+
+/**
+ * @brief Sends a request to the provider, or asks the engine to read its window.
+ * 
+ * @param fetch Request to post.
+ * @param stats Reference to the download statistics.
+ */
+static void post_fetch(segmentfetch& fetch, peerstats& stats) {
+    if (fetch.path == FETCH_GET) {
+        rmaget get = {fetch.request, fetch.slot};
+        engine_send(*comm, fetch.provider, ENGINE_RMA_GET, &get, sizeof(rmaget));
+        stats.rmaGets++;
+    } else {
+        engine_send(*comm, fetch.provider, TAG_SEGMENT_REQUEST, &fetch.request, sizeof(segmentrequest));
+    }
+}
+
+/**
+ * @brief Posts every request of a round and waits for all the replies.
+ * Providers of the same node are read in place, other providers through MPI_Get when
+ * the windows are enabled, window reads finding an empty slot or failing verification are
+ * requested again by message.
+ * The first verified copy of a segment is kept, pending duplicates are cancelled.
+ * 
+ * @param file Name of the file.
+ * @param fetches Requests of the round, one per (segment, provider) pair.
+ * @param swarm Reference to the file swarm data, holds the expected hashes.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param state Reference to the download state of the file.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
+ */
+static void fetch_segments(const string& file, vector<segmentfetch>& fetches, trackedfile& swarm,
+    const swarmconfig& config, filestate& state, localstore& store, peerstats& stats) {
+
+    int fetchNo = fetches.size(), waiting = 0;
+    vector<char> answered(fetchNo, 0), cancelled(fetchNo, 0);
+
+    // Copies from the node come first, they may spare the other requests of the round
+    for (int rIdx = 0; rIdx < fetchNo; ++rIdx) {
+        segmentfetch& fetch = fetches[rIdx];
+        memcpy(fetch.request.digest, swarm.segments[fetch.request.segment], HASH_SIZE);
+        // Aliases are looked up by content, the window slot of the file is not theirs
+        fetch.slot = (store.window && !fetch.alias) ? window_slot(*store.window, file.c_str(), fetch.request.segment) : -1;
+        fetch.path = FETCH_MESSAGE;
+        if (fetch.slot < 0) {
+            continue;
+        }
+
+        windowslot* peerSlots = store.window->peers[fetch.provider];
+        fetch.path = (peerSlots && config.rmaMode == RMA_ON) ? FETCH_COPY : FETCH_GET;
+        if (fetch.path != FETCH_COPY || state.owned[fetch.request.segment]) {
+            continue;
+        }
+
+        answered[rIdx] = 1;
+        memcpy(fetch.reply.fileName, fetch.request.fileName, MAX_FILENAME);
+        fetch.reply.segment = fetch.request.segment;
+        fetch.reply.status = window_load(peerSlots[fetch.slot], fetch.reply.hash) ? SEGMENT_OK : SEGMENT_MISSING;
+        stats.rmaCopies++;
+
+        segmentverdict verdict = accept_segment(file, fetch.provider, fetch.reply, swarm, state, store, stats);
+        stats.offersFetched += verdict == SEGMENT_ACCEPTED && fetch.offered;
+        if (window_missed(fetch.reply, verdict)) {
+            // Empty, torn or stale slot, the upload thread of the provider serves it instead
+            fetch.path = FETCH_MESSAGE;
+            answered[rIdx] = 0;
+            stats.rmaFallbacks++;
+        }
+    }
+
+    // Pipeline the rest of the round instead of one request at a time
+    for (int rIdx = 0; rIdx < fetchNo; ++rIdx) {
+        if (answered[rIdx] || state.owned[fetches[rIdx].request.segment]) {
+            answered[rIdx] = 1;
+            continue;
+        }
+        post_fetch(fetches[rIdx], stats);
+        waiting++;
+    }
+
+    while (waiting > 0) {
+        commmessage message = wait_message(TAG_SEGMENT_REPLY);
+        segmentreply reply;
+        memset(&reply, 0, sizeof(segmentreply));
+        memcpy(&reply, message.payload.data(), min(message.payload.size(), sizeof(segmentreply)));
+        int sIdx = reply.segment;
+        waiting--;
+
+        // Replies describe themselves, match them with the request of the provider
+        int match = -1;
+        for (int rIdx = 0; rIdx < fetchNo; ++rIdx) {
+            if (!answered[rIdx] && fetches[rIdx].provider == message.peer && fetches[rIdx].request.segment == sIdx) {
+                answered[rIdx] = 1;
+                match = rIdx;
+                break;
+            }
+        }
+
+        segmentverdict verdict = accept_segment(file, message.peer, reply, swarm, state, store, stats);
+        if (match >= 0 && fetches[match].path == FETCH_GET && window_missed(reply, verdict)) {
+            fetches[match].path = FETCH_MESSAGE;
+            answered[match] = 0;
+            stats.rmaFallbacks++;
+            post_fetch(fetches[match], stats);
+            waiting++;
+            continue;
+        }
+        if (verdict != SEGMENT_ACCEPTED) {
+            continue;
+        }
+        if (match >= 0 && fetches[match].alias) {
+            stats.aliasFetches++;
+        }
+        if (match >= 0 && fetches[match].offered) {
+            stats.offersFetched++;
+        }
+
+        // Withdraw the duplicates of this segment that are still pending, window reads cannot be
+        for (int oIdx = 0; oIdx < fetchNo; ++oIdx) {
+            if (!answered[oIdx] && !cancelled[oIdx] && fetches[oIdx].path == FETCH_MESSAGE
+                && fetches[oIdx].request.segment == sIdx) {
+                engine_send(*comm, fetches[oIdx].provider, TAG_SEGMENT_CANCEL,
+                    &fetches[oIdx].request, sizeof(segmentrequest));
+                cancelled[oIdx] = 1;
+                stats.cancelsSent++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Marks as owned the missing segments whose hash is already in the local store,
+ * under another file or at another index of the same file.
+ * 
+ * @param file Name of the file.
+ * @param swarm Reference to the file swarm data, holds the expected hashes.
+ * @param state Reference to the download state of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
+ */
+static void dedup_segments(const string& file, trackedfile& swarm, filestate& state, int segmentLast,
+    localstore& store, peerstats& stats) {
+
+    for (int sIdx = segmentLast; sIdx < swarm.segmentsNo; ++sIdx) {
+        if (!state.owned[sIdx] && lookup_digest(store, swarm.segments[sIdx])) {
+            own_segment(file, swarm, state, sIdx, swarm.segments[sIdx], store);
+            stats.dedupHits++;
+            LOG_TRACE("dedup_hit", LOG_NONE, file.c_str(), sIdx, LOG_NONE);
+        }
+    }
+}
+
+/**
+ * @brief Requests a segment from the providers owning its hash at another location.
+ * 
+ * @param fetches Requests of the round.
+ * @param fetch Request template holding the file name.
+ * @param swarm Reference to the file swarm data, holds the aliases.
+ * @param sIdx Index of the segment.
+ * @param rank The rank of the current MPI task.
+ * @param wanted Maximum number of requests added.
+ * @return The number of requests added.
+ */
+static int add_alias_fetches(vector<segmentfetch>& fetches, segmentfetch fetch, const trackedfile& swarm,
+    int sIdx, int rank, int wanted) {
+
+    int added = 0;
+    fetch.alias = true;
+    fetch.request.segment = sIdx;
+
+    for (const auto& alias : swarm.aliases) {
+        if (added < wanted && alias.segment == sIdx && alias.provider != rank) {
+            fetch.provider = alias.provider;
+            fetches.push_back(fetch);
+            added++;
+        }
+    }
+    return added;
+}
+
+/**
+ * @brief Picks the (segment, provider) requests of the next round, without any communication
+ * so the simulator takes the same decisions as the clients.
+ * A round fetches state.policy.batch missing segments from one random provider. Once no more than
+ * config.endgameSegments segments are missing, every missing segment is requested from up to
+ * config.endgameProviders providers at once (endgame mode).
+ * 
+ * @param file Name of the file.
+ * @param rank The rank of the current MPI task.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @param swarm Reference to the file swarm data, its providers are shuffled.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param state Reference to the download state of the file.
+ * @param stats Reference to the download statistics.
+ * @param g Random generator used to order the providers.
+ * @return The requests of the round.
+ */
+vector<segmentfetch> plan_round(const string& file, int rank, int segmentLast, trackedfile& swarm,
+    const swarmconfig& config, filestate& state, peerstats& stats, mt19937& g) {
+
+    int missing = count(state.owned.begin() + segmentLast, state.owned.end(), 0);
+    stats.rounds++;
+
+    // Shuffle the providers vector to randomize the order of selection
+    shuffle(swarm.providers.begin(), swarm.providers.end(), g);
+
+    vector<segmentfetch> fetches;
+    segmentfetch fetch;
+    memset(&fetch, 0, sizeof(segmentfetch));
+    strncpy(fetch.request.fileName, file.c_str(), MAX_FILENAME - 1);
+
+    if (config.endgameSegments > 0 && missing <= config.endgameSegments) {
+        if (!state.endgame) {
+            state.endgame = true;
+            stats.endgameEntries++;
+            LOG_DEBUG("endgame", LOG_NONE, file.c_str(), segmentLast, missing);
+        }
+
+        // Ask several providers for every missing segment
+        for (int sIdx = segmentLast; sIdx < swarm.segmentsNo; ++sIdx) {
+            if (state.owned[sIdx]) {
+                continue;
+            }
+
+            int asked = 0;
+            for (auto& client : swarm.providers) {
+                if (asked == config.endgameProviders) {
+                    break;
+                }
+                if (client.id != rank && client.interval.first <= sIdx && client.interval.last > sIdx) {
+                    fetch.provider = client.id;
+                    fetch.request.segment = sIdx;
+                    fetches.push_back(fetch);
+                    asked++;
+                }
+            }
+            asked += add_alias_fetches(fetches, fetch, swarm, sIdx, rank, config.endgameProviders - asked);
+            stats.endgameRequests += max(asked - 1, 0);
+        }
+    } else {
+        for (auto& client : swarm.providers) {
+            if (client.id != rank && client.interval.last > segmentLast) {
+                // If the client has a last_hash greater than segmentLast, select it as seed
+                int sEnd = min(min(segmentLast + state.policy.batch, client.interval.last), swarm.segmentsNo);
+                // Leave the tail of the file to endgame mode
+                sEnd = min(sEnd, max(segmentLast + 1, swarm.segmentsNo - config.endgameSegments));
+                for (int sIdx = segmentLast; sIdx < sEnd; ++sIdx) {
+                    if (!state.owned[sIdx]) {
+                        fetch.provider = client.id;
+                        fetch.request.segment = sIdx;
+                        fetches.push_back(fetch);
+                    }
+                }
+                // Exit loop after selecting the provider
+                break;
+            }
+        }
+
+        // No provider of the file is far enough, the same content may be owned elsewhere
+        int sEnd = fetches.empty() ? min(segmentLast + state.policy.batch, swarm.segmentsNo) : segmentLast;
+        for (int sIdx = segmentLast; sIdx < sEnd; ++sIdx) {
+            if (!state.owned[sIdx]) {
+                add_alias_fetches(fetches, fetch, swarm, sIdx, rank, 1);
+            }
+        }
+    }
+
+    // A super seed is hidden from the providers, it only serves what it offers to this client
+    const client& offer = swarm.offer;
+    if (offer.id >= 0 && offer.id != rank) {
+        fetch.provider = offer.id;
+        fetch.offered = true;
+        for (int sIdx = max(offer.interval.first, segmentLast); sIdx < offer.interval.last; ++sIdx) {
+            if (!state.owned[sIdx]) {
+                fetch.request.segment = sIdx;
+                fetches.push_back(fetch);
+            }
+        }
+    }
+
+    return fetches;
+}
+
+/**
+ * @brief Advances over the segments owned so far.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @return The number of segments owned without a gap from the first one.
+ */
+int advance_segments(const filestate& state, int segmentLast) {
+    while (segmentLast < (int) state.owned.size() && state.owned[segmentLast]) {
+        segmentLast++;
+    }
+    return segmentLast;
+}
+
+/**
+ * @brief Adapts the batch of a file to a completed round.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param requested Segments requested in the round.
+ * @param acquired Segments of the round that were verified and stored.
+ * @param elapsed Duration of the round in seconds.
+ */
+void end_round(filestate& state, int requested, int acquired, double elapsed) {
+    // Endgame rounds ask for duplicates on purpose, they do not size the batch
+    if (!state.endgame) {
+        policy_round(state.policy, requested, acquired, elapsed);
+    }
+}
+
+/**
+ * @brief Processes segments of a file, one round planned by plan_round.
  * 
  * @param files Array of file names.
  * @param rank The rank of the current MPI task.
- * @param segmentLast Reference to the last processed segment.
+ * @param segmentLast Reference to the number of segments owned, counted from the first one.
  * @param fIdx Index of the current file being processed.
  * @param swarm Reference to the file swarm data.
- * @param segmentsNo The total number of segments in the file.
+ * @param segmentsNo The total number of providers in the swarm.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param state Reference to the download state of the file.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics.
  */
-void process_file_segments(string* files, int rank, int& segmentLast, int fIdx, trackedfile& swarm, int segmentsNo) {
-    char fileName[MAX_FILENAME];
-    strcpy(fileName, files[fIdx].c_str());
+void process_file_segments(string* files, int rank, int& segmentLast, int fIdx, trackedfile& swarm, int segmentsNo,
+    const swarmconfig& config, filestate& state, localstore& store, peerstats& stats) {
+
+    const string& file = files[fIdx];
+    dedup_segments(file, swarm, state, segmentLast, store, stats);
 
-    // Shuffle the providers vector to randomize the order of selection
     random_device rd;
     mt19937 g(rd());
-    shuffle(swarm.providers.begin(), swarm.providers.end(), g);
+    vector<segmentfetch> fetches = plan_round(file, rank, segmentLast, swarm, config, state, stats, g);
 
-    for (auto& client : swarm.providers) {
-        if (client.interval.last > segmentLast) {
-            // If the client has a last_hash greater than segmentLast, select it as seed
-            int seeder = client.id;
-            int sIdx;
-            for (sIdx = segmentLast; sIdx < segmentLast + 10 && sIdx < swarm.segmentsNo; sIdx++) {
-                MPI_Send(&fileName, MAX_FILENAME, MPI_CHAR, seeder, 0, MPI_COMM_WORLD);
-                MPI_Recv(&recvMsg, 1, MPI_CHAR, seeder, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            }
-            segmentLast = sIdx;
-            // Exit loop after processing segments
-            break;
-        }
+    int ownedBefore = count(state.owned.begin(), state.owned.end(), 1);
+    double roundStart = now_seconds();
+    fetch_segments(file, fetches, swarm, config, state, store, stats);
+    int acquired = count(state.owned.begin(), state.owned.end(), 1) - ownedBefore;
+    end_round(state, fetches.size(), acquired, now_seconds() - roundStart);
+
+    segmentLast = advance_segments(state, segmentLast);
+    LOG_TRACE("segments_fetched", LOG_NONE, file.c_str(), segmentLast, (int) fetches.size());
+}
+
+/**
+ * @brief Counts the segments offered by a super seed that are still missing.
+ * 
+ * @param swarm Reference to the file swarm data, holds the offer.
+ * @param state Reference to the download state of the file.
+ * @return The number of missing offered segments, 0 without an offer.
+ */
+int offer_missing(const trackedfile& swarm, const filestate& state) {
+    const client& offer = swarm.offer;
+    if (offer.id < 0) {
+        return 0;
     }
+    return count(state.owned.begin() + offer.interval.first, state.owned.begin() + offer.interval.last, 0);
+}
+
+/**
+ * @brief Picks the offered segments to report beyond the owned prefix.
+ * 
+ * @param swarm Reference to the file swarm data, holds the offer.
+ * @param state Reference to the download state of the file.
+ * @param segmentLast Number of segments owned, counted from the first one.
+ * @return The fetched offer if it lies beyond segmentLast, empty otherwise.
+ */
+hashrange offered_segments(const trackedfile& swarm, const filestate& state, int segmentLast) {
+    hashrange offered = {0, 0};
+    if (swarm.offer.id >= 0 && offer_missing(swarm, state) == 0 && swarm.offer.interval.last > segmentLast) {
+        offered = swarm.offer.interval;
+    }
+    return offered;
+}
+
+/**
+ * @brief Tells whether the swarm of a file has to be queried again after a round.
+ * Swarm queries are independent from progress reports, a stalled round forces one.
+ * 
+ * @param state Reference to the download state of the file.
+ * @param segmentsNo Number of segments of the file.
+ * @param segmentPrev segmentLast before the round.
+ * @param segmentLast segmentLast after the round.
+ * @param segmentRefresh segmentLast at the last swarm query.
+ * @return True if the file is incomplete and the round stalled or the refresh interval elapsed.
+ */
+bool swarm_due(const filestate& state, int segmentsNo, int segmentPrev, int segmentLast, int segmentRefresh) {
+    bool stalled = segmentLast == segmentPrev;
+    return segmentLast < segmentsNo && (stalled || segmentLast - segmentRefresh >= state.policy.refresh);
 }
 
 /**
- * @brief Finalizes file assembly and saves it.
+ * @brief Finalizes file assembly and saves it, progress is reported separately.
  * 
  * @param files Array of file names.
  * @param rank The rank of the current MPI task.
@@ -110,16 +688,13 @@ void finalize_file_save(string* files, int rank, int& segmentLast, int fIdx, tra
     char fileName[MAX_FILENAME];
     strcpy(fileName, files[fIdx].c_str());
 
-    MPI_Send(&fileName, MAX_FILENAME, MPI_CHAR, 0, 2, MPI_COMM_WORLD);
-    MPI_Send(&segmentLast, 1, MPI_INT, 0, 2, MPI_COMM_WORLD);
-
     if (segmentLast == swarm.segmentsNo) {
+        LOG_DEBUG("file_complete", LOG_NONE, fileName, segmentLast, swarm.segmentsNo);
         string clientFile = "client" + to_string(rank) + "_" + fileName;
         ofstream resultFile(clientFile);
 
         for (auto line : swarm.segments) {
             if (resultFile.is_open()) {
-                line[HASH_SIZE] = '\0';
                 resultFile << line << endl;
             }
         }
@@ -132,28 +707,72 @@ void finalize_file_save(string* files, int rank, int& segmentLast, int fIdx, tra
  * @param rank The rank of the current MPI task.
  * @param fileNo The number of files to download.
  * @param fileNames Pointer to an array of file names.
+ * @param config Run configuration broadcast by the coordinator.
+ * @param engine Reference to the communication engine of the client.
+ * @param store Reference to the local segment store shared with the upload thread.
+ * @param stats Reference to the download statistics gathered at shutdown.
  */
-void download_thread(int rank, int fileNo, void* fileNames) {    
+void download_thread(int rank, int fileNo, void* fileNames, swarmconfig config,
+    commengine& engine, localstore& store, peerstats& stats) {
     string* files = (string*) fileNames;
+    comm = &engine;
+    offers = config.superSeed;
     int segmentsNo = 0;
     int segmentLast = 0;
     int filesDownloaded =  0;
+    double downloadStart = now_seconds();
 
-    // Send file information to the coordinator
-    send_file_swarm(fileNo, files, rank);
+    // Progress of every file is buffered and flushed in batches
+    progressbatch progress;
+    progress.pendingSegments = 0;
+    progress.lastFlush = downloadStart;
 
     for (int fIdx = 0; fIdx < fileNo; ++fIdx) {
         // Receive file swarm information
-        trackedfile swarm = receive_file_swarm(segmentsNo, rank);
+        trackedfile swarm = request_file_swarm(files[fIdx], segmentsNo, rank);
+        filestate state = {vector<char>(swarm.segmentsNo, 0), false};
+        policy_init(state.policy, config, swarm.segmentsNo);
+        stats.swarmQueries++;
+
+        // Segments verified by a previous run are not fetched again
+        resume_segments(files[fIdx], swarm, state, store, stats);
+        segmentLast = advance_segments(state, segmentLast);
+        if (swarm.segmentsNo > 0) {
+            checkpoint_open(state.log, rank, files[fIdx], swarm.segmentsNo, config.checkpointSync);
+        }
+        int segmentRefresh = segmentLast;
 
         // While not all segments have been processed
         while (segmentLast < swarm.segmentsNo) {
+            int segmentPrev = segmentLast;
+            bool offerPending = offer_missing(swarm, state) > 0;
             // Process a chunk of file segments
-            process_file_segments(files, rank, segmentLast, fIdx, swarm, segmentsNo);
+            process_file_segments(files, rank, segmentLast, fIdx, swarm, segmentsNo, config, state, store, stats);
+
+            // A fetched offer is reported at once, the super seed waits for it to be re-shared
+            bool offerFetched = offerPending && offer_missing(swarm, state) == 0;
+            hashrange offered = offered_segments(swarm, state, segmentLast);
+            record_progress(progress, files[fIdx], segmentLast, segmentLast - segmentPrev, offered);
+            flush_progress(progress, config, offerFetched);
+
+            if (swarm_due(state, swarm.segmentsNo, segmentPrev, segmentLast, segmentRefresh)) {
+                trackedfile previous = swarm;
+                swarm = request_file_swarm(files[fIdx], segmentsNo, rank);
+                policy_swarm(state.policy, previous, swarm);
+                stats.swarmQueries++;
+                for (auto segment : previous.segments) {
+                    free(segment);
+                }
+                segmentRefresh = segmentLast;
+            }
         }
 
         // Finalize file assembly and save it
         finalize_file_save(files, rank, segmentLast, fIdx, swarm);
+        checkpoint_close(state.log, segmentLast == swarm.segmentsNo);
+        if (stats.filesDone < MAX_FILES) {
+            stats.completion[stats.filesDone++] = now_seconds() - downloadStart;
+        }
 
         // Cleanup allocated memory for this file's data
         for (auto segment : swarm.segments) {
@@ -162,12 +781,18 @@ void download_thread(int rank, int fileNo, void* fileNames) {
 
         // Reset last segment index for the next file
         segmentLast = 0;
+        filesDownloaded++;
     }
 
+    if (fileNo == 0) {
+        return; // Not a leecher, the coordinator does not wait for it
+    }
+
+    // Report what is still buffered before leaving the swarm
+    flush_progress(progress, config, true);
+
     // Notify the coordinator that this client has finished its downloads
     recvMsg = FIN;
-    MPI_Send(&recvMsg, 1, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
-    cout << "No. of files downloaded "
-         << "(inclusive files that are not containing all the hashes): "
-         << ++filesDownloaded << "\n";
+    engine_send(*comm, TRACKER_RANK, TAG_FIN, &recvMsg, 1);
+    LOG_INFO("downloads_done", LOG_NONE, nullptr, LOG_NONE, filesDownloaded);
 }
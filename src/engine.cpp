@@ -0,0 +1,252 @@
+#include "../include/engine.h"
+#include "../utils/file_info.h"
+#include "../utils/logger.h"
+#include "../utils/swarm.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <thread>
+
+using namespace std;
+
+struct pendingsend {
+    MPI_Request request;        // Nonblocking send in flight
+    commmessage message;        // Keeps the payload alive until the send completes
+};
+
+struct pendingget {
+    MPI_Request request;        // MPI_Rget in flight
+    int peer;                   // Rank owning the window
+    rmaget get;                 // Segment read
+    windowslot slot;            // Receives the slot of the peer
+};
+
+/**
+ * @brief Moves queued messages into an inbox, in order, as long as it has room.
+ *
+ * @param backlog Messages received but not delivered yet.
+ * @param inbox Inbox of the consuming thread.
+ * @return True if at least one message was delivered.
+ */
+static bool deliver(deque<commmessage>& backlog, comminbox& inbox) {
+    bool moved = false;
+
+    while (!backlog.empty() && inbox.try_push(backlog.front())) {
+        backlog.pop_front();
+        moved = true;
+    }
+    return moved;
+}
+
+/**
+ * @brief Starts a nonblocking send for every message queued by the client threads,
+ * window reads are started as MPI_Rget under the lock_all epoch of the engine.
+ *
+ * @param engine Reference to the communication engine.
+ * @param sends Sends in flight.
+ * @param gets Window reads in flight.
+ * @return True if at least one send or read was started.
+ */
+static bool post_sends(commengine& engine, list<pendingsend>& sends, list<pendingget>& gets) {
+    bool moved = false;
+    commmessage message;
+
+    while (engine.outbox.try_pop(message)) {
+        if (message.tag == ENGINE_RMA_GET) {
+            gets.emplace_back();
+            pendingget& get = gets.back();
+            get.peer = message.peer;
+            memcpy(&get.get, message.payload.data(), min(message.payload.size(), sizeof(rmaget)));
+            MPI_Rget(&get.slot, sizeof(windowslot), MPI_BYTE, get.peer, get.get.slot,
+                sizeof(windowslot), MPI_BYTE, engine.window->worldWin, &get.request);
+            moved = true;
+            continue;
+        }
+
+        sends.emplace_back();
+        pendingsend& send = sends.back();
+        send.message = move(message);
+        MPI_Isend(send.message.payload.data(), send.message.payload.size(), MPI_BYTE,
+            send.message.peer, send.message.tag, MPI_COMM_WORLD, &send.request);
+        moved = true;
+    }
+    return moved;
+}
+
+/**
+ * @brief Releases the payloads of the completed sends.
+ *
+ * @param sends Sends in flight.
+ */
+static void complete_sends(list<pendingsend>& sends) {
+    int done = 0;
+
+    for (auto it = sends.begin(); it != sends.end();) {
+        MPI_Test(&it->request, &done, MPI_STATUS_IGNORE);
+        it = done ? sends.erase(it) : next(it);
+    }
+}
+
+/**
+ * @brief Turns the completed window reads into segment replies for the download thread.
+ *
+ * @param gets Window reads in flight.
+ * @param toDownload Backlog of the download thread.
+ * @return True if at least one read completed.
+ */
+static bool complete_gets(list<pendingget>& gets, deque<commmessage>& toDownload) {
+    bool moved = false;
+    int done = 0;
+
+    for (auto it = gets.begin(); it != gets.end();) {
+        MPI_Test(&it->request, &done, MPI_STATUS_IGNORE);
+        if (!done) {
+            ++it;
+            continue;
+        }
+
+        segmentreply reply;
+        memset(&reply, 0, sizeof(segmentreply));
+        memcpy(reply.fileName, it->get.request.fileName, MAX_FILENAME);
+        reply.segment = it->get.request.segment;
+        reply.status = it->slot.valid ? SEGMENT_OK : SEGMENT_MISSING;
+        memcpy(reply.hash, it->slot.hash, HASH_SIZE);
+
+        commmessage message;
+        message.peer = it->peer;
+        message.tag = TAG_SEGMENT_REPLY;
+        message.payload.assign((const char*) &reply, (const char*) &reply + sizeof(segmentreply));
+        toDownload.push_back(move(message));
+
+        it = gets.erase(it);
+        moved = true;
+    }
+    return moved;
+}
+
+/**
+ * @brief Receives every pending message and routes it by tag, one tag has one direction.
+ *
+ * @param toDownload Backlog of the download thread.
+ * @param toUpload Backlog of the upload thread.
+ * @return True if at least one message was received.
+ */
+static bool receive_messages(deque<commmessage>& toDownload, deque<commmessage>& toUpload) {
+    bool moved = false;
+    int flag = 0, bytes = 0;
+    MPI_Status status;
+
+    while (true) {
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        if (!flag) {
+            break;
+        }
+
+        commmessage message;
+        MPI_Get_count(&status, MPI_BYTE, &bytes);
+        message.peer = status.MPI_SOURCE;
+        message.tag = status.MPI_TAG;
+        message.payload.resize(bytes);
+        MPI_Recv(message.payload.data(), bytes, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG,
+            MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        moved = true;
+
+        switch (message.tag) {
+        case TAG_SWARM_REPLY:
+        case TAG_SEGMENT_REPLY:
+            toDownload.push_back(move(message));
+            break;
+        case TAG_SEGMENT_REQUEST:
+        case TAG_SEGMENT_CANCEL:
+            toUpload.push_back(move(message));
+            break;
+        default:
+            LOG_WARN("unexpected_tag", message.peer, nullptr, LOG_NONE, message.tag);
+            break;
+        }
+    }
+    return moved;
+}
+
+void engine_run(commengine& engine) {
+    list<pendingsend> sends;
+    list<pendingget> gets;
+    deque<commmessage> toDownload, toUpload;
+
+    // Windows stay readable for the whole run, peers never write remote slots
+    bool rma = engine.window && engine.window->enabled;
+    if (rma) {
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, engine.window->worldWin);
+    }
+
+    // The shutdown broadcast is posted upfront and completed by the coordinator
+    char shutdownMsg = ACK;
+    MPI_Request shutdownReq;
+    MPI_Ibcast(&shutdownMsg, 1, MPI_CHAR, TRACKER_RANK, MPI_COMM_WORLD, &shutdownReq);
+
+    while (true) {
+        // Read before draining the outbox, the threads push everything before they finish
+        bool threadsDone = engine.downloadDone.load(memory_order_acquire)
+                        && engine.uploadDone.load(memory_order_acquire);
+
+        bool moved = post_sends(engine, sends, gets);
+        complete_sends(sends);
+        moved |= complete_gets(gets, toDownload);
+        moved |= receive_messages(toDownload, toUpload);
+        moved |= deliver(toDownload, engine.downloadInbox);
+        moved |= deliver(toUpload, engine.uploadInbox);
+
+        // Flag the shutdown only once the upload thread got every request
+        if (!engine.shutdown.load(memory_order_relaxed) && toUpload.empty()) {
+            int flag = 0;
+            MPI_Test(&shutdownReq, &flag, MPI_STATUS_IGNORE);
+            if (flag) {
+                if (shutdownMsg != FIN) {
+                    LOG_WARN("engine_shutdown_unexpected", TRACKER_RANK, nullptr, LOG_NONE, shutdownMsg);
+                }
+                engine.shutdown.store(true, memory_order_release);
+                moved = true;
+            }
+        }
+
+        if (threadsDone && engine.shutdown.load(memory_order_relaxed) && sends.empty() && gets.empty() && !moved) {
+            break;
+        }
+        if (!moved) {
+            this_thread::sleep_for(chrono::microseconds(ENGINE_IDLE_US));
+        }
+    }
+
+    if (rma) {
+        MPI_Win_unlock_all(engine.window->worldWin);
+    }
+    LOG_DEBUG("engine_stopped", LOG_NONE, nullptr, LOG_NONE, (int) (toDownload.size() + toUpload.size()));
+}
+
+void engine_send(commengine& engine, int peer, int tag, const void* data, size_t size) {
+    commmessage message;
+    message.peer = peer;
+    message.tag = tag;
+    message.payload.assign((const char*) data, (const char*) data + size);
+
+    while (!engine.outbox.try_push(message)) {
+        this_thread::sleep_for(chrono::microseconds(ENGINE_IDLE_US));
+    }
+}
+
+commmessage engine_receive(comminbox& inbox) {
+    commmessage message;
+
+    for (int spin = 0; !inbox.try_pop(message); ++spin) {
+        if (spin < ENGINE_WAIT_SPINS) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(ENGINE_IDLE_US));
+        }
+    }
+    return message;
+}
@@ -0,0 +1,551 @@
+#include "../include/simulator.h"
+#include "../include/download.h"
+#include "../server/server.h"
+#include "../utils/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <random>
+
+using namespace std;
+
+enum simkind {
+    SIM_JOIN,                       // Leecher (re)joins the swarm
+    SIM_LEAVE,                      // Leecher goes offline, its requests in flight are lost
+    SIM_SWARM,                      // Swarm reply reaches the client
+    SIM_REQUEST,                    // Segment request reaches the provider
+    SIM_SENT,                       // Provider uplink finished sending a segment
+    SIM_REPLY                       // Segment reply reaches the client
+};
+
+struct simevent {
+    double time;                    // Virtual time in seconds
+    long order;                     // Tie breaker, events of the same time run in posting order
+    simkind kind;
+    int peer;                       // Client the event happens on
+    int epoch;                      // Online session of the requesting client when posted
+    int source;                     // Requesting client of a request, provider of a reply
+    int segment;                    // Segment of a request or reply
+    bool ok;                        // Reply carries the segment
+
+    bool operator>(const simevent& other) const {
+        return time != other.time ? time > other.time : order > other.order;
+    }
+};
+
+struct simpeer {
+    bool online = false;
+    bool done = false;
+    int epoch = 0;                  // Bumped when the client leaves, stale events are dropped
+    double latency = 0;             // One-way latency of the access link, seconds
+    double segmentTime = 0;         // Seconds to upload one segment
+    bool uploading = false;         // A segment is on the uplink
+    deque<simevent> uploads;        // Requests waiting for the uplink, served in arrival order
+    double joined = -1;             // First join, completion is measured from there
+    int segmentLast = 0;            // Segments owned, counted from the first one
+    int segmentRefresh = 0;         // segmentLast at the last swarm query
+    int roundStart = 0;             // segmentLast when the round in flight started
+    double roundTime = 0;           // Time the round in flight started
+    int roundRequested = 0;         // Segments requested by the round in flight
+    int roundOwned = 0;             // Segments owned when the round in flight started
+    bool roundOffer = false;        // Offered segments were missing when the round in flight started
+    int pending = 0;                // Replies missing to close the round in flight
+    progressbatch progress;         // Progress not reported yet, on the virtual clock
+    filestate state;                // Same download state as a real client
+    trackedfile swarm;              // Last swarm reply
+    peerstats stats;                // Same statistics as a real client
+};
+
+struct simulation {
+    simconfig sim;
+    swarmconfig config;
+    string file;                    // Name given to the simulated file
+    trackedfile tracked;            // Tracker view of the swarm
+    int leechers = 0;               // Tracker count of the clients still downloading
+    int remaining = 0;              // Leechers that did not complete yet
+    vector<simpeer> peers;          // Index 0 is the tracker, as the MPI rank
+    priority_queue<simevent, vector<simevent>, greater<simevent>> events;
+    long posted = 0;
+    mt19937 g;
+};
+
+/**
+ * @brief Queues an event.
+ *
+ * @param run Reference to the simulation.
+ * @param event Event to run, its order is assigned here.
+ */
+static void post(simulation& run, simevent event) {
+    event.order = run.posted++;
+    run.events.push(event);
+}
+
+/**
+ * @brief Draws a value uniformly between half and one and a half times the mean.
+ *
+ * @param run Reference to the simulation.
+ * @param mean Mean of the distribution.
+ * @return The drawn value.
+ */
+static double spread(simulation& run, double mean) {
+    return uniform_real_distribution<double>(0.5 * mean, 1.5 * mean)(run.g);
+}
+
+/**
+ * @brief Answers a swarm query, a random sample of the providers when the swarm is large.
+ * Super seeds are hidden behind the offer made to the client, as on the tracker.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client asking for the swarm.
+ * @return The swarm as sent by the tracker.
+ */
+static trackedfile swarm_reply(simulation& run, int rank) {
+    trackedfile swarm;
+    swarm.segmentsNo = run.tracked.segmentsNo;
+    swarm.aliases = run.tracked.pieces;
+    swarm.offer = super_offer(run.tracked, rank, run.config.segmentBatch);
+
+    int providersNo = run.tracked.providers.size();
+    if (run.sim.swarmSample == 0 || providersNo <= run.sim.swarmSample) {
+        swarm.providers = run.tracked.providers;
+        return swarm;
+    }
+
+    // Up to swarmSample distinct providers, duplicate draws are dropped
+    vector<int> picked(run.sim.swarmSample);
+    uniform_int_distribution<int> pick(0, providersNo - 1);
+    for (auto& pIdx : picked) {
+        pIdx = pick(run.g);
+    }
+    sort(picked.begin(), picked.end());
+    picked.erase(unique(picked.begin(), picked.end()), picked.end());
+    for (int pIdx : picked) {
+        swarm.providers.push_back(run.tracked.providers[pIdx]);
+    }
+    return swarm;
+}
+
+/**
+ * @brief Sends the buffered progress of a client to the tracker, with the flush rules of
+ * flush_progress. The tracker view changes at once, its latency is not modelled.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client reporting its progress.
+ * @param now Current virtual time.
+ * @param force Flush even if neither the count nor the time threshold was reached.
+ */
+static void flush_sim_progress(simulation& run, int rank, double now, bool force) {
+    progressbatch& progress = run.peers[rank].progress;
+    if (!progress_due(progress, run.config, now, force)) {
+        return;
+    }
+
+    bool changed = false;
+    for (const auto& entry : progress.entries) {
+        changed = apply_progress(run.tracked, run.leechers, rank, entry.segmentLast) || changed;
+        changed = apply_piece(run.tracked, rank, entry.offered) || changed;
+    }
+    if (changed) {
+        mark_distributed(run.tracked, now);
+    }
+    progress.entries.clear();
+    progress.pendingSegments = 0;
+    progress.lastFlush = now;
+}
+
+/**
+ * @brief Completes the download of a client, its progress is reported at once.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client owning every segment.
+ * @param now Current virtual time.
+ */
+static void complete(simulation& run, int rank, double now) {
+    simpeer& peer = run.peers[rank];
+    flush_sim_progress(run, rank, now, true);
+    peer.done = true;
+    peer.stats.completion[peer.stats.filesDone++] = now - peer.joined;
+    run.remaining--;
+}
+
+static void finish_round(simulation& run, int rank, double now);
+
+/**
+ * @brief Queries the tracker, the reply arrives after a round trip.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client asking for the swarm.
+ * @param now Current virtual time.
+ */
+static void query_swarm(simulation& run, int rank, double now) {
+    simpeer& peer = run.peers[rank];
+    post(run, {now + 2 * peer.latency, 0, SIM_SWARM, rank, peer.epoch, TRACKER_RANK, LOG_NONE, false});
+    peer.stats.swarmQueries++;
+}
+
+/**
+ * @brief Plans the next round of a client with plan_round and posts its requests.
+ * Segments of a round abandoned by a departure are owned but were never counted, the client
+ * advances over them first, as a restarted client does over its checkpoint.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client starting the round.
+ * @param now Current virtual time.
+ */
+static void start_round(simulation& run, int rank, double now) {
+    simpeer& peer = run.peers[rank];
+    int segmentPrev = peer.segmentLast;
+    peer.segmentLast = advance_segments(peer.state, peer.segmentLast);
+    if (peer.segmentLast > segmentPrev) {
+        record_progress(peer.progress, run.file, peer.segmentLast, peer.segmentLast - segmentPrev, {0, 0});
+    }
+    if (peer.segmentLast == peer.swarm.segmentsNo) {
+        complete(run, rank, now);
+        return;
+    }
+
+    vector<segmentfetch> fetches = plan_round(run.file, rank, peer.segmentLast, peer.swarm,
+        run.config, peer.state, peer.stats, run.g);
+
+    peer.roundStart = peer.segmentLast;
+    peer.roundTime = now;
+    peer.roundRequested = fetches.size();
+    peer.roundOwned = count(peer.state.owned.begin(), peer.state.owned.end(), 1);
+    peer.roundOffer = offer_missing(peer.swarm, peer.state) > 0;
+    peer.pending = fetches.size();
+    if (fetches.empty()) {
+        // Nobody to ask, the round stalls at once
+        finish_round(run, rank, now);
+        return;
+    }
+    for (const auto& fetch : fetches) {
+        double arrival = now + peer.latency + run.peers[fetch.provider].latency;
+        post(run, {arrival, 0, SIM_REQUEST, fetch.provider, peer.epoch, rank, fetch.request.segment, false});
+    }
+}
+
+/**
+ * @brief Closes a round once every reply arrived, with the decisions of the download thread.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Client whose round is complete.
+ * @param now Current virtual time.
+ */
+static void finish_round(simulation& run, int rank, double now) {
+    simpeer& peer = run.peers[rank];
+    peer.segmentLast = advance_segments(peer.state, peer.segmentLast);
+    int acquired = count(peer.state.owned.begin(), peer.state.owned.end(), 1) - peer.roundOwned;
+    end_round(peer.state, peer.roundRequested, acquired, now - peer.roundTime);
+
+    // A fetched offer is reported at once, the super seed waits for it to be re-shared
+    bool offerFetched = peer.roundOffer && offer_missing(peer.swarm, peer.state) == 0;
+    hashrange offered = offered_segments(peer.swarm, peer.state, peer.segmentLast);
+    record_progress(peer.progress, run.file, peer.segmentLast, peer.segmentLast - peer.roundStart, offered);
+
+    if (peer.segmentLast == peer.swarm.segmentsNo) {
+        complete(run, rank, now);
+        return;
+    }
+    flush_sim_progress(run, rank, now, offerFetched);
+
+    if (swarm_due(peer.state, peer.swarm.segmentsNo, peer.roundStart, peer.segmentLast, peer.segmentRefresh)) {
+        query_swarm(run, rank, now);
+    } else {
+        start_round(run, rank, now);
+    }
+}
+
+/**
+ * @brief Answers a request, the reply reaches the client after the latency of both links.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Provider answering.
+ * @param request Request being answered.
+ * @param now Time the reply leaves the provider.
+ * @param ok The reply carries the segment.
+ */
+static void reply(simulation& run, int rank, const simevent& request, double now, bool ok) {
+    double arrival = now + run.peers[rank].latency + run.peers[request.source].latency;
+    post(run, {arrival, 0, SIM_REPLY, request.source, request.epoch, rank, request.segment, ok});
+}
+
+/**
+ * @brief Puts the next queued request on the uplink, as the upload thread takes its queue in order.
+ * Requests of clients that left since are dropped, missing segments are answered at once.
+ *
+ * @param run Reference to the simulation.
+ * @param rank Provider serving its queue.
+ * @param now Current virtual time.
+ */
+static void serve_next(simulation& run, int rank, double now) {
+    simpeer& peer = run.peers[rank];
+    peer.uploading = false;
+
+    while (!peer.uploads.empty()) {
+        simevent request = peer.uploads.front();
+        peer.uploads.pop_front();
+        if (request.epoch != run.peers[request.source].epoch) {
+            continue;
+        }
+        if (!peer.state.owned[request.segment]) {
+            reply(run, rank, request, now, false);
+            continue;
+        }
+
+        request.kind = SIM_SENT;
+        request.time = now + peer.segmentTime;
+        post(run, request);
+        peer.uploading = true;
+        return;
+    }
+}
+
+/**
+ * @brief Runs one event.
+ *
+ * @param run Reference to the simulation.
+ * @param event Event taken out of the queue.
+ */
+static void run_event(simulation& run, const simevent& event) {
+    simpeer& peer = run.peers[event.peer];
+
+    switch (event.kind) {
+    case SIM_JOIN:
+        peer.online = true;
+        if (peer.joined < 0) {
+            peer.joined = event.time;
+            peer.progress.lastFlush = event.time;
+        }
+        if (run.sim.churnMs > 0) {
+            double session = exponential_distribution<double>(1000.0 / run.sim.churnMs)(run.g);
+            post(run, {event.time + session, 0, SIM_LEAVE, event.peer, peer.epoch, LOG_NONE, LOG_NONE, false});
+        }
+        query_swarm(run, event.peer, event.time);
+        break;
+
+    case SIM_LEAVE:
+        if (peer.done || event.epoch != peer.epoch) {
+            break;
+        }
+        // Owned segments survive, as with a checkpoint, unflushed progress is lost
+        peer.online = false;
+        peer.epoch++;
+        peer.pending = 0;
+        peer.progress.entries.clear();
+        peer.progress.pendingSegments = 0;
+        // Queued requests fail as if the connection dropped, their clients move on
+        for (const auto& request : peer.uploads) {
+            reply(run, event.peer, request, event.time, false);
+        }
+        peer.uploads.clear();
+        post(run, {event.time + run.sim.downtimeMs / 1000.0, 0, SIM_JOIN, event.peer, peer.epoch, LOG_NONE, LOG_NONE, false});
+        break;
+
+    case SIM_SWARM:
+        if (event.epoch != peer.epoch || !peer.online) {
+            break;
+        }
+        {
+            // The first reply has nothing to be compared with
+            trackedfile previous = move(peer.swarm);
+            peer.swarm = swarm_reply(run, event.peer);
+            if (!previous.providers.empty()) {
+                policy_swarm(peer.state.policy, previous, peer.swarm);
+            }
+        }
+        peer.segmentRefresh = peer.segmentLast;
+        start_round(run, event.peer, event.time);
+        break;
+
+    case SIM_REQUEST:
+        if (!peer.online) {
+            reply(run, event.peer, event, event.time, false);
+            break;
+        }
+        peer.uploads.push_back(event);
+        if (!peer.uploading) {
+            serve_next(run, event.peer, event.time);
+        }
+        break;
+
+    case SIM_SENT:
+        reply(run, event.peer, event, event.time, peer.online);
+        peer.stats.segmentsServed += peer.online;
+        serve_next(run, event.peer, event.time);
+        break;
+
+    case SIM_REPLY:
+        if (event.epoch != peer.epoch || !peer.online || peer.done) {
+            break;
+        }
+        if (event.ok && peer.state.owned[event.segment]) {
+            peer.stats.redundantBytes += HASH_SIZE;
+        } else if (event.ok) {
+            peer.state.owned[event.segment] = 1;
+            peer.stats.segmentsFetched++;
+            peer.stats.offersFetched += event.source == peer.swarm.offer.id;
+        }
+        if (--peer.pending == 0) {
+            finish_round(run, event.peer, event.time);
+        }
+        break;
+    }
+}
+
+simconfig load_sim_config(void) {
+    simconfig sim;
+
+    sim.peers = env_int("BT_SIM_PEERS", SIM_PEERS, 2);
+    sim.seeds = min(env_int("BT_SIM_SEEDS", SIM_SEEDS), sim.peers - 1);
+    sim.segments = min(env_int("BT_SIM_SEGMENTS", SIM_SEGMENTS), MAX_CHUNKS);
+    sim.segmentKib = env_int("BT_SIM_SEGMENT_KIB", SIM_SEGMENT_KIB);
+    sim.latencyUs = env_int("BT_SIM_LATENCY_US", SIM_LATENCY_US);
+    sim.uplinkKib = env_int("BT_SIM_UPLINK_KIB", SIM_UPLINK_KIB);
+    sim.arrivalMs = env_int("BT_SIM_ARRIVAL_MS", SIM_ARRIVAL_MS, 0);
+    sim.churnMs = env_int("BT_SIM_CHURN_MS", SIM_CHURN_MS, 0);
+    sim.downtimeMs = env_int("BT_SIM_DOWNTIME_MS", SIM_DOWNTIME_MS, 0);
+    sim.swarmSample = env_int("BT_SIM_SWARM_SAMPLE", SIM_SWARM_SAMPLE, 0);
+    sim.seed = env_int("BT_SIM_SEED", SIM_SEED, 0);
+    sim.limitS = env_int("BT_SIM_LIMIT_S", SIM_LIMIT_S);
+    sim.baseline = env_int("BT_SIM_BASELINE", SIM_BASELINE, 0);
+
+    return sim;
+}
+
+/**
+ * @brief Builds the swarm of a simulation and runs it until every leecher completed,
+ * or until the time limit.
+ *
+ * @param run Reference to the simulation, its parameters and configuration are set.
+ * @param now Reference to store the virtual time of the last event.
+ * @return The number of events processed.
+ */
+static long run_swarm(simulation& run, double& now) {
+    run.g.seed(run.sim.seed);
+    run.file = "simulated";
+    run.tracked.segmentsNo = run.sim.segments;
+
+    // Rank 0 stays the tracker, seeds come first among the clients
+    run.peers.resize(run.sim.peers + 1);
+    for (int rank = 1; rank <= run.sim.peers; ++rank) {
+        simpeer& peer = run.peers[rank];
+        bool seed = rank <= run.sim.seeds;
+
+        peer.latency = spread(run, run.sim.latencyUs / 1e6);
+        peer.segmentTime = run.sim.segmentKib / spread(run, run.sim.uplinkKib);
+        peer.state.owned.assign(run.sim.segments, seed ? 1 : 0);
+        peer.state.endgame = false;
+        policy_init(peer.state.policy, run.config, run.sim.segments);
+        memset(&peer.stats, 0, sizeof(peerstats));
+        peer.progress.pendingSegments = 0;
+        peer.progress.lastFlush = 0;
+
+        if (seed) {
+            peer.online = true;
+            peer.done = true;
+            peer.segmentLast = run.sim.segments;
+            run.tracked.seeds.push_back(rank);
+            if (run.config.superSeed) {
+                run.tracked.superSeeds.push_back(rank);
+            } else {
+                run.tracked.providers.push_back({rank, SEED, 0, run.sim.segments});
+            }
+            continue;
+        }
+
+        run.leechers++;
+        run.remaining++;
+        double join = run.sim.arrivalMs > 0 ? uniform_real_distribution<double>(0, run.sim.arrivalMs / 1000.0)(run.g) : 0;
+        post(run, {join, 0, SIM_JOIN, rank, 0, LOG_NONE, LOG_NONE, false});
+    }
+
+    long processed = 0;
+    now = 0;
+    while (!run.events.empty() && run.remaining > 0) {
+        simevent event = run.events.top();
+        if (event.time > run.sim.limitS) {
+            break; // Churn can keep a swarm from ever completing
+        }
+        run.events.pop();
+        now = event.time;
+        run_event(run, event);
+        processed++;
+    }
+    return processed;
+}
+
+/**
+ * @brief Collects the statistics of every client of a simulation, seeds included.
+ *
+ * @param run Reference to the simulation.
+ * @return The statistics, as gathered by the tracker of an MPI run.
+ */
+static vector<peerstats> client_stats(const simulation& run) {
+    vector<peerstats> stats;
+    for (int rank = 1; rank <= run.sim.peers; ++rank) {
+        stats.push_back(run.peers[rank].stats);
+    }
+    return stats;
+}
+
+/**
+ * @brief Runs the same swarm without endgame mode and logs the p99 completion gain of endgame mode.
+ *
+ * @param run Reference to the finished simulation, with endgame mode on.
+ */
+static void report_endgame_gain(const simulation& run) {
+    simulation baseline;
+    baseline.sim = run.sim;
+    baseline.config = run.config;
+    baseline.config.endgameSegments = 0;
+    double now;
+    run_swarm(baseline, now);
+
+    // A positive gain means endgame mode shortened the slowest downloads
+    double p99 = completion_percentile(client_stats(run), 99);
+    double baselineP99 = completion_percentile(client_stats(baseline), 99);
+    LOG_REPORT("sim_baseline_p99_ms", LOG_NONE, nullptr, LOG_NONE, (int) (baselineP99 * 1000));
+    LOG_REPORT("sim_endgame_p99_gain_ms", LOG_NONE, nullptr, LOG_NONE, (int) ((baselineP99 - p99) * 1000));
+    LOG_REPORT("sim_endgame_p99_gain_pct", LOG_NONE, nullptr, LOG_NONE,
+        baselineP99 > 0 ? (int) ((baselineP99 - p99) * 100 / baselineP99) : 0);
+    if (baseline.remaining > 0) {
+        LOG_REPORT("sim_baseline_incomplete", LOG_NONE, nullptr, LOG_NONE, baseline.remaining);
+    }
+}
+
+int simulate(void) {
+    auto wallStart = chrono::steady_clock::now();
+    simulation run;
+    run.sim = load_sim_config();
+    run.config = load_config();
+    double now;
+    long processed = run_swarm(run, now);
+
+    double wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - wallStart).count();
+    LOG_REPORT("sim_peers", LOG_NONE, nullptr, LOG_NONE, run.sim.peers);
+    LOG_REPORT("sim_events", LOG_NONE, nullptr, LOG_NONE, (int) min(processed, (long) INT32_MAX));
+    LOG_REPORT("sim_virtual_ms", LOG_NONE, nullptr, LOG_NONE, (int) (now * 1000));
+    LOG_REPORT("sim_wall_ms", LOG_NONE, nullptr, LOG_NONE, (int) wallMs);
+    if (run.tracked.distributed >= 0) {
+        LOG_REPORT("sim_distributed_ms", LOG_NONE, nullptr, LOG_NONE, (int) (run.tracked.distributed * 1000));
+    }
+    int seedServed = 0;
+    for (int rank = 1; rank <= run.sim.seeds; ++rank) {
+        seedServed += run.peers[rank].stats.segmentsServed;
+    }
+    LOG_REPORT("sim_seed_served", LOG_NONE, nullptr, LOG_NONE, seedServed);
+    if (run.remaining > 0) {
+        LOG_REPORT("sim_incomplete", LOG_NONE, nullptr, LOG_NONE, run.remaining);
+    }
+
+    // Same metrics as the tracker logs at the end of an MPI run
+    report_stats(client_stats(run));
+    if (run.sim.baseline && run.config.endgameSegments > 0) {
+        report_endgame_gain(run);
+    }
+
+    return run.remaining > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,67 +1,118 @@
 #include "../include/upload.h"
+#include "../utils/logger.h"
 
-#include <mpi.h>
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 using namespace std;
 
-static char recvMsg;
-static MPI_Status status;
+static commengine* comm;    // Engine of the client, owns every MPI call
 
 /**
  * @brief Handle shutdown signal from the coordinator
- * shutdown signal (FIN) is received, false otherwise
  */
 void shutdown_upload(void) {
-    // Receive the shutdown command from the coordinator
-    MPI_Recv(&recvMsg, 1, MPI_CHAR, 0, 0, MPI_COMM_WORLD, &status);
+    LOG_INFO("upload_shutdown", TRACKER_RANK, nullptr, LOG_NONE, LOG_NONE);
+}
+
+/**
+ * @brief Moves every segment request and cancel delivered by the engine into the upload queue
+ * 
+ * @param queue Requests received but not served yet
+ * @return True if at least one message was taken from the inbox
+ */
+bool receive_segment_messages(deque<pendingrequest>& queue) {
+    bool received = false;
+    commmessage message;
 
-    if (recvMsg == FIN) {
-        cout << "Shutdown, uploaded ended!\n";
-        return; // Indicate shutdown upload communication
+    while (comm->uploadInbox.try_pop(message)) {
+        received = true;
+
+        segmentrequest request;
+        memset(&request, 0, sizeof(segmentrequest));
+        memcpy(&request, message.payload.data(), min(message.payload.size(), sizeof(segmentrequest)));
+
+        if (message.tag == TAG_SEGMENT_REQUEST) {
+            queue.push_back({message.peer, request, false});
+            continue;
+        }
+
+        // Cancels only reach requests that are still queued
+        for (auto& pending : queue) {
+            if (pending.source == message.peer && pending.request.segment == request.segment
+                && strncmp(pending.request.fileName, request.fileName, MAX_FILENAME) == 0) {
+                pending.cancelled = true;
+            }
+        }
     }
+    return received;
 }
 
 /**
  * @brief Respond to segment request from clients
+ * 
+ * @param store Local segment store shared with the download thread
+ * @param pending Request taken out of the upload queue
+ * @param stats Upload statistics, written by the upload thread only
  */
-void segment_request_response(void) {
-    recvMsg = ACK;
-    char *segment = new char [HASH_SIZE];
+void segment_request_response(localstore& store, const pendingrequest& pending, peerstats& stats) {
+    segmentreply reply;
+    memset(&reply, 0, sizeof(segmentreply));
+    memcpy(reply.fileName, pending.request.fileName, MAX_FILENAME);
+    reply.fileName[MAX_FILENAME - 1] = '\0';
+    reply.segment = pending.request.segment;
 
-    // Receive the segment request from any source
-    MPI_Recv(segment, HASH_SIZE, MPI_CHAR, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);    
-    // Send acknowledgment (ACK) to the source
-    MPI_Send(&recvMsg, 1, MPI_CHAR, status.MPI_SOURCE, 1, MPI_COMM_WORLD);
+    if (pending.cancelled) {
+        reply.status = SEGMENT_CANCELLED;
+    } else if (lookup_segment(store, reply.fileName, reply.segment, reply.hash)) {
+        reply.status = SEGMENT_OK;
+    } else if (lookup_digest(store, pending.request.digest)) {
+        // Same content owned under another file or index
+        memcpy(reply.hash, pending.request.digest, HASH_SIZE);
+        reply.status = SEGMENT_OK;
+    } else {
+        reply.status = SEGMENT_MISSING;
+    }
+    LOG_TRACE("segment_request", pending.source, reply.fileName, reply.segment, reply.status);
+    stats.segmentsServed += reply.status == SEGMENT_OK;
 
-    delete[] segment;
+    // Send the segment or its status to the source
+    engine_send(*comm, pending.source, TAG_SEGMENT_REPLY, &reply, sizeof(segmentreply));
 }
 
 /**
  * @brief Thread function to handle upload tasks
  * 
- * @param files Map containing file information
+ * @param engine Communication engine of the client
+ * @param store Local segment store shared with the download thread
+ * @param stats Upload statistics, written by the upload thread only
  * @param rank Rank of the current MPI process
  */
-void upload_thread(unordered_map<string, hashes> files, int rank) {
-    bool stopUpload = false;
-    int flag = 0;
-
-    while (!stopUpload) {
-        // Check for incoming messages without blocking
-        MPI_Probe(MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
-        // Test if a message is received
-        MPI_Get_count(&status, MPI_CHAR, &flag);
-
-        if (flag) { // If there's an incoming message
-            if (status.MPI_SOURCE == 0) {
-                // Handle shutdown signal from source 0
-                stopUpload = true;
-                shutdown_upload();
-            } else {
-                // Process segment requests from other sources
-                segment_request_response();
-            }
+void upload_thread(commengine& engine, localstore& store, peerstats& stats, int rank) {
+    deque<pendingrequest> queue;
+    comm = &engine;
+
+    while (true) {
+        // Read before draining, the engine delivers everything before it flags the shutdown
+        bool stopUpload = engine.shutdown.load(memory_order_acquire);
+        bool received = receive_segment_messages(queue);
+
+        if (!queue.empty()) {
+            // Process segment requests from other clients
+            segment_request_response(store, queue.front(), stats);
+            queue.pop_front();
+            continue;
+        }
+
+        if (stopUpload && !received) {
+            // Handle shutdown signal from the coordinator
+            shutdown_upload();
+            break;
+        }
+        if (!received) {
+            this_thread::sleep_for(chrono::microseconds(UPLOAD_IDLE_US));
         }
     }
 }
@@ -0,0 +1,121 @@
+#include "checkpoint.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * @brief Location of the checkpoint of a file, next to the saved output.
+ *
+ * @param rank The rank of the current client.
+ * @param file Name of the file.
+ * @return The path of the log.
+ */
+static string checkpoint_path(int rank, const string& file) {
+    return "client" + to_string(rank) + "_" + file + ".ckpt";
+}
+
+int checkpoint_load(int rank, const string& file, vector<string>& hashes) {
+    int fd = open(checkpoint_path(rank, file).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    checkpointheader header;
+    if (read(fd, &header, sizeof(checkpointheader)) != sizeof(checkpointheader)
+        || strncmp(header.fileName, file.c_str(), MAX_FILENAME) != 0
+        || header.segmentsNo <= 0 || header.segmentsNo > MAX_CHUNKS) {
+        LOG_WARN("checkpoint_invalid", LOG_NONE, file.c_str(), LOG_NONE, LOG_NONE);
+        close(fd);
+        return 0;
+    }
+
+    int verified = 0;
+    checkpointentry entry;
+    hashes.assign(header.segmentsNo, string());
+    while (read(fd, &entry, sizeof(checkpointentry)) == sizeof(checkpointentry)) {
+        if (entry.segment < 0 || entry.segment >= header.segmentsNo) {
+            continue;
+        }
+        if (hashes[entry.segment].empty()) {
+            verified++;
+        }
+        hashes[entry.segment].assign(entry.hash, HASH_SIZE);
+    }
+    close(fd);
+
+    LOG_INFO("checkpoint_loaded", LOG_NONE, file.c_str(), verified, header.segmentsNo);
+    return verified;
+}
+
+void checkpoint_open(checkpoint& log, int rank, const string& file, int segmentsNo, int syncEvery) {
+    if (syncEvery <= 0) {
+        return;
+    }
+
+    log.path = checkpoint_path(rank, file);
+    log.syncEvery = syncEvery;
+    log.unsynced = 0;
+    log.fd = open(log.path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log.fd < 0) {
+        LOG_WARN("checkpoint_open_failed", LOG_NONE, file.c_str(), LOG_NONE, errno);
+        return;
+    }
+
+    // A log left by a previous run keeps its header, a torn last entry is cut off
+    // and a torn header is written again, as for a new log
+    off_t size = lseek(log.fd, 0, SEEK_END);
+    off_t torn = size < (off_t) sizeof(checkpointheader)
+        ? size : (size - sizeof(checkpointheader)) % sizeof(checkpointentry);
+    if (torn && ftruncate(log.fd, size - torn) != 0) {
+        LOG_WARN("checkpoint_write_failed", LOG_NONE, file.c_str(), LOG_NONE, errno);
+    }
+    if (size == torn) {
+        checkpointheader header;
+        memset(&header, 0, sizeof(checkpointheader));
+        strncpy(header.fileName, file.c_str(), MAX_FILENAME - 1);
+        header.segmentsNo = segmentsNo;
+        if (write(log.fd, &header, sizeof(checkpointheader)) != sizeof(checkpointheader)) {
+            LOG_WARN("checkpoint_write_failed", LOG_NONE, file.c_str(), LOG_NONE, errno);
+        }
+    }
+}
+
+void checkpoint_append(checkpoint& log, int segment, const char* hash) {
+    if (log.fd < 0) {
+        return;
+    }
+
+    checkpointentry entry;
+    entry.segment = segment;
+    memcpy(entry.hash, hash, HASH_SIZE);
+    if (write(log.fd, &entry, sizeof(checkpointentry)) != sizeof(checkpointentry)) {
+        LOG_WARN("checkpoint_write_failed", LOG_NONE, nullptr, segment, errno);
+    }
+
+    // Batch the syncs, a crash loses at most the last syncEvery entries
+    if (++log.unsynced >= log.syncEvery) {
+        fdatasync(log.fd);
+        log.unsynced = 0;
+    }
+}
+
+void checkpoint_close(checkpoint& log, bool complete) {
+    if (log.fd < 0) {
+        return;
+    }
+
+    if (log.unsynced > 0 && !complete) {
+        fdatasync(log.fd);
+    }
+    close(log.fd);
+    log.fd = -1;
+
+    if (complete) {
+        unlink(log.path.c_str());
+    }
+}
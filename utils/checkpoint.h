@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H 1
+
+#include "file_info.h"
+
+#include <string>
+#include <vector>
+
+// Checkpoint of a partial download, a checkpointheader followed by one
+// checkpointentry per verified segment, appended in the order they arrived
+struct checkpointheader {
+    char fileName[MAX_FILENAME];        // File being downloaded
+    int segmentsNo;                     // Number of segments of the file
+};
+
+struct checkpointentry {
+    int segment;                        // Index of the verified segment
+    char hash[HASH_SIZE];               // Segment payload
+};
+
+struct checkpoint {
+    int fd = -1;                        // Log opened in append mode, -1 when disabled
+    int unsynced = 0;                   // Entries written since the last fsync
+    int syncEvery = 0;                  // Entries between two fsync calls
+    std::string path;                   // Location of the log
+};
+
+/**
+ * @brief Reads the checkpoint of a file left by a previous run.
+ * A truncated last entry, from a run that died while writing it, is ignored.
+ *
+ * @param rank The rank of the current client.
+ * @param file Name of the file.
+ * @param hashes Receives the verified segments by index, empty strings for the missing ones.
+ * @return The number of verified segments, 0 without a checkpoint.
+ */
+int checkpoint_load(int rank, const std::string& file, std::vector<std::string>& hashes);
+
+/**
+ * @brief Opens the checkpoint of a file for appending, the header is written once (again if torn).
+ *
+ * @param log Reference to the checkpoint of the file.
+ * @param rank The rank of the current client.
+ * @param file Name of the file.
+ * @param segmentsNo Number of segments of the file.
+ * @param syncEvery Entries between two fsync calls, 0 disables the checkpoint.
+ */
+void checkpoint_open(checkpoint& log, int rank, const std::string& file, int segmentsNo, int syncEvery);
+
+/**
+ * @brief Appends a verified segment, the log is synced every log.syncEvery entries.
+ *
+ * @param log Reference to the checkpoint of the file.
+ * @param segment Index of the segment.
+ * @param hash Segment payload, HASH_SIZE characters.
+ */
+void checkpoint_append(checkpoint& log, int segment, const char* hash);
+
+/**
+ * @brief Syncs and closes the checkpoint.
+ *
+ * @param log Reference to the checkpoint of the file.
+ * @param complete The file was saved, the checkpoint is removed.
+ */
+void checkpoint_close(checkpoint& log, bool complete);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,35 @@
+#include "config.h"
+#include "file_info.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+int env_int(const char* name, int fallback, int minimum) {
+    const char* text = getenv(name);
+    if (!text) {
+        return fallback;
+    }
+
+    char* end = nullptr;
+    long value = strtol(text, &end, 10);
+    return (end != text && value >= minimum) ? (int) value : fallback;
+}
+
+swarmconfig load_config(void) {
+    swarmconfig config;
+
+    config.status = ACK;
+    config.segmentBatch = env_int("BT_SEGMENT_BATCH", SEGMENT_BATCH);
+    config.batchMax = std::max(env_int("BT_BATCH_MAX", SEGMENT_BATCH_MAX), config.segmentBatch);
+    config.swarmRefresh = env_int("BT_SWARM_REFRESH", SWARM_REFRESH_SEGMENTS);
+    config.adaptiveRounds = std::min(env_int("BT_ADAPTIVE", ADAPTIVE_ROUNDS, 0), 1);
+    config.progressSegments = env_int("BT_PROGRESS_SEGMENTS", PROGRESS_FLUSH_SEGMENTS);
+    config.progressMs = env_int("BT_PROGRESS_MS", PROGRESS_FLUSH_MS);
+    config.endgameSegments = env_int("BT_ENDGAME_SEGMENTS", ENDGAME_SEGMENTS, 0);
+    config.endgameProviders = env_int("BT_ENDGAME_PROVIDERS", ENDGAME_PROVIDERS);
+    config.rmaMode = std::min(env_int("BT_RMA", RMA_MODE, RMA_OFF), RMA_GET);
+    config.checkpointSync = env_int("BT_CHECKPOINT_SYNC", CHECKPOINT_SYNC_SEGMENTS, 0);
+    config.superSeed = std::min(env_int("BT_SUPER_SEED", SUPER_SEED, 0), 1);
+
+    return config;
+}
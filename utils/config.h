@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef CONFIG_H
+#define CONFIG_H 1
+
+#define SEGMENT_BATCH 10            // Segments fetched from one provider in the first round
+#define SEGMENT_BATCH_MAX 64        // Largest batch reached by the adaptive rounds
+#define SWARM_REFRESH_SEGMENTS 10   // Segments downloaded between the first two swarm queries
+#define ADAPTIVE_ROUNDS 1           // Batch and refresh interval follow round times and churn
+#define PROGRESS_FLUSH_SEGMENTS 50  // Acquired segments that force a progress flush
+#define PROGRESS_FLUSH_MS 50        // Time after which buffered progress is flushed
+#define ENDGAME_SEGMENTS 5          // Missing segments below which endgame mode starts
+#define ENDGAME_PROVIDERS 3         // Providers asked for the same segment in endgame mode
+
+#define CHECKPOINT_SYNC_SEGMENTS 16 // Checkpointed segments between two fsync calls
+
+#define SUPER_SEED 0                // Initial seeds advertise one rare segment per leecher
+#define SUPER_SEED_PATIENCE 4       // Swarm queries after which an offer is replaced even if not re-shared
+
+#define RMA_OFF 0                   // Segments are always requested from the upload thread
+#define RMA_ON 1                    // Memory copy on the same node, MPI_Get across nodes
+#define RMA_GET 2                   // MPI_Get for every provider, even on the same node
+#define RMA_MODE RMA_ON
+
+struct swarmconfig {
+    char status;                // ACK once the tracker registered every client
+    int segmentBatch;           // Segments fetched from one provider in the first round
+    int batchMax;               // Largest batch reached by the adaptive rounds
+    int swarmRefresh;           // Segments downloaded between the first two swarm queries
+    int adaptiveRounds;         // Batch and refresh interval adapt, 0 keeps them fixed
+    int progressSegments;       // Acquired segments that force a progress flush
+    int progressMs;             // Milliseconds after which buffered progress is flushed
+    int endgameSegments;        // Missing segments below which endgame mode starts, 0 disables it
+    int endgameProviders;       // Providers asked for the same segment in endgame mode
+    int rmaMode;                // RMA_OFF, RMA_ON or RMA_GET
+    int checkpointSync;         // Checkpointed segments between two fsync calls, 0 disables checkpoints
+    int superSeed;              // Initial seeds are hidden behind per leecher offers
+};
+
+/**
+ * @brief Reads an integer from the environment.
+ *
+ * @param name Name of the environment variable.
+ * @param fallback Value used when the variable is missing or invalid.
+ * @param minimum Smallest accepted value.
+ * @return The parsed value or the fallback.
+ */
+int env_int(const char* name, int fallback, int minimum = 1);
+
+/**
+ * @brief Builds the run configuration on the tracker.
+ * Defaults can be overridden with BT_SEGMENT_BATCH, BT_BATCH_MAX, BT_SWARM_REFRESH, BT_ADAPTIVE,
+ * BT_PROGRESS_SEGMENTS, BT_PROGRESS_MS, BT_ENDGAME_SEGMENTS, BT_ENDGAME_PROVIDERS, BT_RMA, BT_CHECKPOINT_SYNC
+ * and BT_SUPER_SEED.
+ *
+ * @return The configuration broadcast to every client.
+ */
+swarmconfig load_config(void);
+
+#endif // CONFIG_H
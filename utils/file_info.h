@@ -5,6 +5,7 @@
 
 #include "swarm.h"
 
+#include <memory>
 #include <vector>
 
 #define HASH_SIZE 32
@@ -12,19 +13,87 @@
 
 #define MAX_FILENAME 15
 #define MAX_CHUNKS 100
+#define MAX_ALIASES 2          // Providers of the same content listed per segment
 
 #define FIN '0'
 #define ACK '1'
 
+#define SEGMENT_OK 0           // Reply carries the segment
+#define SEGMENT_MISSING 1      // Provider does not own the segment (yet)
+#define SEGMENT_CANCELLED 2    // Request withdrawn before it was served
+
 struct hashes {
     int hashesNo;
     std::vector<std::string> hashesCurr;        
 };
 
+struct segmentalias {
+    int segment;                       // Segment of the requested file
+    int provider;                      // Client owning the same hash elsewhere, or the segment beyond its prefix
+};
+
+struct superoffer {
+    int leecher;                       // Leecher the segments are offered to
+    int provider;                      // Initial seed serving them
+    hashrange interval;                // Segments advertised to the leecher only
+    int asks;                          // Swarm queries of the leecher since the offer was made
+};
+
 struct trackedfile {
-    int segmentsNo;                    // Number of segments
+    int segmentsNo = 0;                // Number of segments
     std::vector<char*> segments;       // All hashes needed
     std::vector<client> providers;     // Data hashes and client details
+    std::vector<segmentalias> aliases; // Providers owning the same hashes elsewhere
+    std::vector<int> providerSlot;     // Tracker only, cached position of every client in providers
+    int version = 0;                   // Tracker only, bumped whenever the providers change
+    std::vector<int> seeds;            // Tracker only, clients owning the file when they registered
+    std::vector<int> superSeeds;       // Tracker only, initial seeds hidden behind per leecher offers
+    std::vector<superoffer> offers;    // Tracker only, offers not re-shared yet
+    std::vector<segmentalias> pieces;  // Tracker only, offered segments owned beyond the prefix of their client
+    double distributed = -1;           // Tracker only, time every segment was first held by a non initial seed
+    client offer = {-1, SEED, 0, 0};   // Segments a super seed offers to this client, id -1 if none
+    std::shared_ptr<const std::vector<char>> reply; // Tracker only, encoded swarm reply, null once stale
+};
+
+// Registration manifest of a client, packed as a manifestheader, then a manifestfile
+// followed by its hashes for every owned file, then MAX_FILENAME bytes per wanted file,
+// then a progressentry per wanted file resumed from a checkpoint
+struct manifestheader {
+    int ownedNo;                       // Files owned by the client
+    int wantedNo;                      // Files the client wants to download
+    int resumedNo;                     // Wanted files partially owned after a restart
+};
+
+struct manifestfile {
+    char fileName[MAX_FILENAME];       // Owned file name
+    int hashesNo;                      // Number of hashes following the entry
+};
+
+struct progressentry {
+    char fileName[MAX_FILENAME];       // File the progress refers to
+    int segmentLast;                   // Segments owned, counted from the first one
+    hashrange offered;                 // Segments obtained from a super seed beyond segmentLast, empty if none
+};
+
+// Swarm reply, packed as a swarmheader, the providers, HASH_SIZE bytes per segment, then the aliases.
+// With super seeding a second message follows, the client offered to the requester only, id -1 if none
+struct swarmheader {
+    int providersNo;                   // Number of client entries following the header
+    int segmentsNo;                    // Number of segment hashes following the providers
+    int aliasesNo;                     // Number of segmentalias entries following the hashes
+};
+
+struct segmentrequest {
+    char fileName[MAX_FILENAME];       // File the segment belongs to
+    int segment;                       // Index of the wanted segment
+    char digest[HASH_SIZE];            // Expected hash, served from any file owning it
+};
+
+struct segmentreply {
+    char fileName[MAX_FILENAME];       // File the segment belongs to
+    int segment;                       // Index of the served segment
+    int status;                        // SEGMENT_OK, SEGMENT_MISSING or SEGMENT_CANCELLED
+    char hash[HASH_SIZE];              // Segment payload, valid with SEGMENT_OK
 };
 
 #endif // FILE_INFO_H
@@ -0,0 +1,157 @@
+#include "logger.h"
+#include "queue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <thread>
+
+using namespace std;
+
+std::atomic<int> logRuntimeLevel(LOG_LEVEL_INFO);
+
+static mpscqueue<logrecord, LOG_RING_SIZE> ring;
+
+static atomic<bool> running(false);
+static atomic<long> dropped(0);
+static thread drainer;
+static int logRank = LOG_NONE;
+static chrono::steady_clock::time_point logStart;
+
+static const char* levelNames[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF", "REPORT"};
+
+/**
+ * @brief Parses a level given either by name (debug, info...) or by number.
+ *
+ * @param text Value of the BT_LOG_LEVEL environment variable.
+ * @return The matching level, LOG_LEVEL_INFO when it cannot be parsed.
+ */
+static int parse_level(const char* text) {
+    for (int level = LOG_LEVEL_TRACE; level <= LOG_LEVEL_ERROR; ++level) {
+        if (strcasecmp(text, levelNames[level]) == 0) {
+            return level;
+        }
+    }
+    if (strcasecmp(text, "off") == 0) {
+        return LOG_LEVEL_OFF;
+    }
+
+    char* end = nullptr;
+    long level = strtol(text, &end, 10);
+    if (end != text && level >= LOG_LEVEL_TRACE && level <= LOG_LEVEL_OFF) {
+        return (int) level;
+    }
+    return LOG_LEVEL_INFO;
+}
+
+/**
+ * @brief Formats a record, only the structured fields that are set are printed.
+ *
+ * @param record The record taken out of the ring buffer.
+ */
+static void write_record(const logrecord& record) {
+    // Results go to stdout with the regular records, only warnings and errors to stderr
+    bool failure = record.level == LOG_LEVEL_WARN || record.level == LOG_LEVEL_ERROR;
+    FILE* out = failure ? stderr : stdout;
+
+    fprintf(out, "[%10.6f] %-5s rank=%d event=%s",
+        record.time, levelNames[record.level], record.rank, record.event);
+    if (record.peer != LOG_NONE) {
+        fprintf(out, " peer=%d", record.peer);
+    }
+    if (record.file[0] != '\0') {
+        fprintf(out, " file=%.*s", MAX_FILENAME, record.file);
+    }
+    if (record.segment != LOG_NONE) {
+        fprintf(out, " segment=%d", record.segment);
+    }
+    if (record.value != LOG_NONE) {
+        fprintf(out, " value=%d", record.value);
+    }
+    fputc('\n', out);
+}
+
+/**
+ * @brief Pops every record currently published in the ring buffer.
+ *
+ * @return The number of records written.
+ */
+static int drain_ring(void) {
+    int drained = 0;
+    logrecord record;
+
+    while (ring.try_pop(record)) {
+        write_record(record);
+        drained++;
+    }
+
+    if (drained) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return drained;
+}
+
+/**
+ * @brief Background loop, sleeps while the ring buffer is empty.
+ */
+static void drain_loop(void) {
+    while (running.load(memory_order_acquire)) {
+        if (!drain_ring()) {
+            this_thread::sleep_for(chrono::milliseconds(2));
+        }
+    }
+    drain_ring();
+}
+
+void log_init(int rank) {
+    logRank = rank;
+    logStart = chrono::steady_clock::now();
+
+    const char* level = getenv("BT_LOG_LEVEL");
+    if (level) {
+        log_set_level(parse_level(level));
+    }
+
+    running.store(true, memory_order_release);
+    drainer = thread(drain_loop);
+}
+
+void log_shutdown(void) {
+    if (!running.exchange(false)) {
+        return;
+    }
+    drainer.join();
+
+    long lost = dropped.load();
+    if (lost) {
+        fprintf(stderr, "[LOG]: rank %d dropped %ld records, ring buffer full\n", logRank, lost);
+    }
+}
+
+void log_set_level(int level) {
+    logRuntimeLevel.store(level, memory_order_relaxed);
+}
+
+void log_push(int level, const char* event,
+    int peer, const char* file, int segment, int value) {
+
+    logrecord record;
+    record.level = level;
+    record.rank = logRank;
+    record.peer = peer;
+    record.segment = segment;
+    record.value = value;
+    record.event = event;
+    record.time = chrono::duration<double>(chrono::steady_clock::now() - logStart).count();
+    memset(record.file, 0, sizeof(record.file));
+    if (file) {
+        strncpy(record.file, file, MAX_FILENAME);
+    }
+
+    if (!ring.try_push(record)) {
+        dropped.fetch_add(1, memory_order_relaxed); // Ring buffer full, never block the caller
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#ifndef LOGGER_H
+#define LOGGER_H 1
+
+#include "file_info.h"
+
+#include <atomic>
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF   5
+#define LOG_LEVEL_REPORT 6 // Results of a run, never filtered
+
+// Records below this level are removed by the preprocessor (make LOG_LEVEL=<n>)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE 4096 // Must be a power of two
+#define LOG_NONE -1        // Marks an unused structured field
+
+struct logrecord {
+    int level;                  // Severity of the record
+    int rank;                   // Rank that emitted the record
+    int peer;                   // Remote rank involved in the event
+    int segment;                // Segment index the event refers to
+    int value;                  // Event specific value (counts, totals, types)
+    double time;                // Seconds elapsed since log_init
+    const char* event;          // Static event name, never freed
+    char file[MAX_FILENAME];    // File the event refers to
+};
+
+// Runtime threshold, checked before a record is built
+extern std::atomic<int> logRuntimeLevel;
+
+/**
+ * @brief Starts the background thread that drains the log ring buffer.
+ * The runtime level is read from the BT_LOG_LEVEL environment variable.
+ *
+ * @param rank Rank stamped on every record emitted by this process.
+ */
+void log_init(int rank);
+
+/**
+ * @brief Stops the drain thread, flushes pending records and reports drops.
+ */
+void log_shutdown(void);
+
+/**
+ * @brief Changes the runtime level, records below it are discarded.
+ *
+ * @param level One of the LOG_LEVEL_* values.
+ */
+void log_set_level(int level);
+
+/**
+ * @brief Enqueues a structured record without blocking or formatting.
+ * When the ring buffer is full the record is dropped and counted.
+ *
+ * @param level Severity of the record.
+ * @param event Static event name.
+ * @param peer Remote rank involved, LOG_NONE if not relevant.
+ * @param file File name, nullptr if not relevant.
+ * @param segment Segment index, LOG_NONE if not relevant.
+ * @param value Event specific value, LOG_NONE if not relevant.
+ */
+void log_push(int level, const char* event,
+    int peer, const char* file, int segment, int value);
+
+#define LOG_EMIT(level, event, peer, file, segment, value)                  \
+    do {                                                                    \
+        if ((level) >= logRuntimeLevel.load(std::memory_order_relaxed)) {   \
+            log_push((level), (event), (peer), (file), (segment), (value)); \
+        }                                                                   \
+    } while (0)
+
+// Results are printed whatever the compile-time and runtime levels
+#define LOG_REPORT(event, peer, file, segment, value) \
+    log_push(LOG_LEVEL_REPORT, (event), (peer), (file), (segment), (value))
+
+// Compiled out records still use their arguments, which are never evaluated
+#define LOG_DISCARD(level, event, peer, file, segment, value)               \
+    do {                                                                    \
+        if (0) {                                                            \
+            log_push((level), (event), (peer), (file), (segment), (value)); \
+        }                                                                   \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_EMIT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) LOG_DISCARD(LOG_LEVEL_TRACE, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_EMIT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISCARD(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_EMIT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISCARD(LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_EMIT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISCARD(LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_EMIT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISCARD(LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
+
+#endif // LOGGER_H
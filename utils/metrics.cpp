@@ -0,0 +1,126 @@
+#include "metrics.h"
+#include "logger.h"
+#include "swarm.h"
+
+#include <mpi.h>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+/**
+ * @brief Nearest rank percentile of sorted samples.
+ *
+ * @param sorted Samples in ascending order.
+ * @param percent Wanted percentile, between 0 and 100.
+ * @return The percentile, 0 without samples.
+ */
+static double percentile(const vector<double>& sorted, double percent) {
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    size_t rank = (size_t) (percent / 100.0 * sorted.size() + 0.999999);
+    rank = max((size_t) 1, min(rank, sorted.size()));
+    return sorted[rank - 1];
+}
+
+/**
+ * @brief Converts seconds to microseconds for the log, long simulated runs saturate.
+ *
+ * @param seconds Duration in seconds.
+ * @return The duration in microseconds, at most INT_MAX.
+ */
+static int to_us(double seconds) {
+    return (int) min(seconds * 1e6, (double) INT_MAX);
+}
+
+/**
+ * @brief Collects the completion times of every file, in ascending order.
+ *
+ * @param stats Statistics of every client.
+ * @return The sorted completion times in seconds.
+ */
+static vector<double> sorted_completion(const vector<peerstats>& stats) {
+    vector<double> completion;
+    for (const auto& peer : stats) {
+        completion.insert(completion.end(), peer.completion, peer.completion + min(peer.filesDone, MAX_FILES));
+    }
+    sort(completion.begin(), completion.end());
+    return completion;
+}
+
+void gather_stats(const peerstats& local, int numtasks, int rank) {
+    vector<peerstats> stats(rank == TRACKER_RANK ? numtasks : 0);
+
+    MPI_Gather(&local, sizeof(peerstats), MPI_BYTE,
+        stats.data(), sizeof(peerstats), MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
+
+    if (rank == TRACKER_RANK) {
+        // The tracker does not download, drop its slot
+        stats.erase(stats.begin());
+        report_stats(stats);
+    }
+}
+
+void report_stats(const vector<peerstats>& stats) {
+    vector<double> completion = sorted_completion(stats);
+    long redundantBytes = 0;
+    int segmentsFetched = 0, endgameEntries = 0, endgameRequests = 0;
+    int cancelsSent = 0, cancelledReplies = 0;
+    int rmaCopies = 0, rmaGets = 0, rmaFallbacks = 0;
+    int dedupHits = 0, aliasFetches = 0, resumedSegments = 0;
+    int rounds = 0, swarmQueries = 0;
+    int segmentsServed = 0, servedMax = 0, offersFetched = 0;
+
+    for (const auto& peer : stats) {
+        segmentsFetched += peer.segmentsFetched;
+        endgameEntries += peer.endgameEntries;
+        endgameRequests += peer.endgameRequests;
+        cancelsSent += peer.cancelsSent;
+        cancelledReplies += peer.cancelledReplies;
+        redundantBytes += peer.redundantBytes;
+        rmaCopies += peer.rmaCopies;
+        rmaGets += peer.rmaGets;
+        rmaFallbacks += peer.rmaFallbacks;
+        dedupHits += peer.dedupHits;
+        aliasFetches += peer.aliasFetches;
+        resumedSegments += peer.resumedSegments;
+        rounds += peer.rounds;
+        swarmQueries += peer.swarmQueries;
+        segmentsServed += peer.segmentsServed;
+        servedMax = max(servedMax, peer.segmentsServed);
+        offersFetched += peer.offersFetched;
+    }
+
+    LOG_REPORT("report_files", LOG_NONE, nullptr, LOG_NONE, (int) completion.size());
+    LOG_REPORT("report_completion_p50_us", LOG_NONE, nullptr, LOG_NONE, to_us(percentile(completion, 50)));
+    LOG_REPORT("report_completion_p99_us", LOG_NONE, nullptr, LOG_NONE, to_us(percentile(completion, 99)));
+    LOG_REPORT("report_completion_max_us", LOG_NONE, nullptr, LOG_NONE, to_us(percentile(completion, 100)));
+    LOG_REPORT("report_segments_fetched", LOG_NONE, nullptr, LOG_NONE, segmentsFetched);
+    LOG_REPORT("report_endgame_entries", LOG_NONE, nullptr, LOG_NONE, endgameEntries);
+    LOG_REPORT("report_endgame_requests", LOG_NONE, nullptr, LOG_NONE, endgameRequests);
+    LOG_REPORT("report_endgame_cancels", LOG_NONE, nullptr, LOG_NONE, cancelsSent);
+    LOG_REPORT("report_endgame_cancelled", LOG_NONE, nullptr, LOG_NONE, cancelledReplies);
+    LOG_REPORT("report_redundant_bytes", LOG_NONE, nullptr, LOG_NONE, (int) redundantBytes);
+    LOG_REPORT("report_rma_copies", LOG_NONE, nullptr, LOG_NONE, rmaCopies);
+    LOG_REPORT("report_rma_gets", LOG_NONE, nullptr, LOG_NONE, rmaGets);
+    LOG_REPORT("report_rma_fallbacks", LOG_NONE, nullptr, LOG_NONE, rmaFallbacks);
+
+    // Hit rate over every segment acquired, local hits cost no traffic at all
+    int acquired = dedupHits + segmentsFetched;
+    LOG_REPORT("report_dedup_hits", LOG_NONE, nullptr, LOG_NONE, dedupHits);
+    LOG_REPORT("report_dedup_hit_pct", LOG_NONE, nullptr, LOG_NONE, acquired ? dedupHits * 100 / acquired : 0);
+    LOG_REPORT("report_dedup_bytes_saved", LOG_NONE, nullptr, LOG_NONE, dedupHits * HASH_SIZE);
+    LOG_REPORT("report_alias_fetches", LOG_NONE, nullptr, LOG_NONE, aliasFetches);
+    LOG_REPORT("report_resumed_segments", LOG_NONE, nullptr, LOG_NONE, resumedSegments);
+    LOG_REPORT("report_rounds", LOG_NONE, nullptr, LOG_NONE, rounds);
+    LOG_REPORT("report_swarm_queries", LOG_NONE, nullptr, LOG_NONE, swarmQueries);
+    LOG_REPORT("report_segments_served", LOG_NONE, nullptr, LOG_NONE, segmentsServed);
+    LOG_REPORT("report_served_max", LOG_NONE, nullptr, LOG_NONE, servedMax);
+    LOG_REPORT("report_offers_fetched", LOG_NONE, nullptr, LOG_NONE, offersFetched);
+}
+
+double completion_percentile(const vector<peerstats>& stats, double percent) {
+    return percentile(sorted_completion(stats), percent);
+}
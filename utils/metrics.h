@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef METRICS_H
+#define METRICS_H 1
+
+#include "file_info.h"
+
+#include <vector>
+
+struct peerstats {
+    int filesDone;                  // Files completed by the client
+    double completion[MAX_FILES];   // Seconds from download start to each file completion
+    int segmentsFetched;            // Segments accepted from other clients
+    int endgameEntries;             // Files that switched to endgame mode
+    int endgameRequests;            // Duplicate requests sent in endgame mode
+    int cancelsSent;                // Duplicate requests withdrawn after the first copy arrived
+    int cancelledReplies;           // Duplicates dropped by the provider before being served
+    long redundantBytes;            // Payload received for segments already owned
+    int rmaCopies;                  // Segments copied from a provider of the same node
+    int rmaGets;                    // Segments read with MPI_Get
+    int rmaFallbacks;               // Window reads that found no valid copy and were requested again
+    int dedupHits;                  // Segments found in the local store under another file or index
+    int aliasFetches;               // Segments fetched from a provider of the same hash elsewhere
+    int resumedSegments;            // Segments restored from a checkpoint instead of fetched
+    int rounds;                     // Rounds planned, endgame ones included
+    int swarmQueries;               // Swarm queries sent to the tracker
+    int segmentsServed;             // Segments sent by the upload thread
+    int offersFetched;              // Segments fetched from a super seed offer
+};
+
+/**
+ * @brief Gathers the statistics of every client on the tracker and reports them.
+ * Collective over MPI_COMM_WORLD, called once by the main thread of every rank.
+ *
+ * @param local Statistics of the calling rank, ignored on the tracker.
+ * @param numtasks Total number of tasks including the tracker.
+ * @param rank Rank of the current task.
+ */
+void gather_stats(const peerstats& local, int numtasks, int rank);
+
+/**
+ * @brief Logs the swarm wide completion percentiles, endgame, window, deduplication, resume, round and upload counters.
+ * They are REPORT records, printed whatever the log level.
+ *
+ * @param stats Statistics of every client.
+ */
+void report_stats(const std::vector<peerstats>& stats);
+
+/**
+ * @brief Completion time percentile over every file completed by the clients.
+ *
+ * @param stats Statistics of every client.
+ * @param percent Wanted percentile, between 0 and 100.
+ * @return The percentile in seconds, 0 without completed files.
+ */
+double completion_percentile(const std::vector<peerstats>& stats, double percent);
+
+#endif // METRICS_H
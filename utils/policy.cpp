@@ -0,0 +1,87 @@
+#include "policy.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+/**
+ * @brief Derives the refresh interval from the batch, a swarm is queried every few rounds.
+ *
+ * @param policy Reference to the policy of the file.
+ */
+static void update_refresh(roundpolicy& policy) {
+    policy.refresh = max(policy.refreshMin, policy.batch * policy.refreshRounds);
+}
+
+void policy_init(roundpolicy& policy, const swarmconfig& config, int segmentsNo) {
+    policy.adaptive = config.adaptiveRounds;
+    policy.batch = config.segmentBatch;
+    policy.refresh = config.swarmRefresh;
+    policy.churned = 0;
+    policy.rttBase = 0;
+    policy.rttSmooth = 0;
+    if (!policy.adaptive) {
+        return;
+    }
+
+    // A small file is fetched in a few rounds, a large one queries the tracker a bounded number of times
+    policy.batchMax = max(1, min(config.batchMax, segmentsNo));
+    policy.batch = min(policy.batch, policy.batchMax);
+    policy.refreshMin = max(1, segmentsNo / POLICY_SWARM_QUERIES);
+    policy.refreshRounds = max(1, config.swarmRefresh / policy.batch);
+    update_refresh(policy);
+}
+
+void policy_round(roundpolicy& policy, int requested, int acquired, double elapsed) {
+    if (!policy.adaptive || requested <= 0) {
+        return;
+    }
+
+    double perSegment = elapsed / requested;
+    if (policy.rttBase == 0 || perSegment < policy.rttBase) {
+        policy.rttBase = perSegment;
+    }
+    policy.rttSmooth = policy.rttSmooth == 0 ? perSegment
+        : (1 - POLICY_RTT_WEIGHT) * policy.rttSmooth + POLICY_RTT_WEIGHT * perSegment;
+
+    if (acquired < requested) {
+        // Missing or corrupt replies, the provider left or is overloaded
+        policy.churned += requested - acquired;
+        policy.batch = max(1, policy.batch / 2);
+    } else if (policy.rttSmooth > POLICY_RTT_SLACK * policy.rttBase) {
+        // Requests queue at the provider, the history is forgiven so one spike halves once
+        policy.batch = max(1, policy.batch / 2);
+        policy.rttSmooth = policy.rttBase;
+    } else if (requested >= policy.batch) {
+        // Only a batch that was used in full grows
+        policy.batch = min(policy.batchMax, policy.batch + 1);
+    }
+    update_refresh(policy);
+    LOG_TRACE("policy_batch", LOG_NONE, nullptr, policy.batch, (int) (policy.rttSmooth * 1e6));
+}
+
+void policy_swarm(roundpolicy& policy, const trackedfile& previous, const trackedfile& current) {
+    if (!policy.adaptive) {
+        return;
+    }
+
+    unordered_set<int> known;
+    for (const auto& provider : previous.providers) {
+        known.insert(provider.id);
+    }
+    for (const auto& provider : current.providers) {
+        policy.churned += !known.count(provider.id);
+    }
+
+    // A changing swarm is queried more often, a stable one less
+    if (policy.churned > 0) {
+        policy.refreshRounds = max(1, policy.refreshRounds / 2);
+    } else {
+        policy.refreshRounds = min(POLICY_REFRESH_ROUNDS_MAX, policy.refreshRounds + 1);
+    }
+    policy.churned = 0;
+    update_refresh(policy);
+    LOG_TRACE("policy_refresh", LOG_NONE, nullptr, policy.refresh, policy.refreshRounds);
+}
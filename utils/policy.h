@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef POLICY_H
+#define POLICY_H 1
+
+#include "config.h"
+#include "file_info.h"
+
+#define POLICY_RTT_WEIGHT 0.125         // Weight of a new sample in the moving average of the round time
+#define POLICY_RTT_SLACK 2.0            // Queueing assumed once the average exceeds the best time this many times
+#define POLICY_REFRESH_ROUNDS_MAX 8     // Most rounds between two swarm queries of a stable swarm
+#define POLICY_SWARM_QUERIES 16         // Regular swarm queries of a file, bounds the refresh interval from below
+
+// Round sizes of one file, additive increase while rounds complete without queueing,
+// multiplicative decrease on losses or growing round times
+struct roundpolicy {
+    bool adaptive;                      // Sizes follow the measurements, fixed ones otherwise
+    int batch;                          // Segments requested per round
+    int batchMax;                       // Largest batch, bounded by the file size
+    int refresh;                        // Segments downloaded between two swarm queries
+    int refreshMin;                     // Smallest refresh interval, bounded by the file size
+    int refreshRounds;                  // Rounds between two swarm queries
+    int churned;                        // Providers joined or segments lost since the last swarm query
+    double rttBase;                     // Best time per segment of a round, seconds
+    double rttSmooth;                   // Moving average of the time per segment of a round, seconds
+};
+
+/**
+ * @brief Sets the starting sizes of a file from the configuration and the file size.
+ *
+ * @param policy Reference to the policy of the file.
+ * @param config Run configuration, holds the starting and the largest batch.
+ * @param segmentsNo Number of segments of the file.
+ */
+void policy_init(roundpolicy& policy, const swarmconfig& config, int segmentsNo);
+
+/**
+ * @brief Adapts the batch to the outcome of a round.
+ *
+ * @param policy Reference to the policy of the file.
+ * @param requested Segments requested in the round.
+ * @param acquired Segments of the round that were verified and stored.
+ * @param elapsed Duration of the round in seconds.
+ */
+void policy_round(roundpolicy& policy, int requested, int acquired, double elapsed);
+
+/**
+ * @brief Adapts the refresh interval to the churn seen when the swarm is queried again.
+ *
+ * @param policy Reference to the policy of the file.
+ * @param previous Swarm of the file before the query.
+ * @param current Swarm of the file returned by the query.
+ */
+void policy_swarm(roundpolicy& policy, const trackedfile& previous, const trackedfile& current);
+
+#endif // POLICY_H
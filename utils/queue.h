@@ -0,0 +1,142 @@
+#pragma once
+
+#ifndef QUEUE_H
+#define QUEUE_H 1
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for many producers and a single consumer.
+ * Every cell carries a sequence number telling producers and the consumer
+ * whether it is free or published, producers only race on the enqueue ticket.
+ *
+ * @tparam T Element type, default constructible and movable.
+ * @tparam N Capacity, must be a power of two.
+ */
+template <typename T, size_t N>
+class mpscqueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+    struct cell {
+        std::atomic<size_t> sequence;   // Free for ticket == sequence, published for ticket + 1
+        T value;                        // Payload written by a producer
+    };
+
+    cell cells[N];
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) size_t dequeuePos;
+
+public:
+    mpscqueue() : enqueuePos(0), dequeuePos(0) {
+        for (size_t cIdx = 0; cIdx < N; ++cIdx) {
+            cells[cIdx].sequence.store(cIdx, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Publishes a value, safe to call from any thread.
+     *
+     * @param value Value moved into the queue on success.
+     * @return False when the queue is full, the value is left untouched.
+     */
+    bool try_push(T& value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        cell* target;
+
+        while (true) {
+            target = &cells[pos & (N - 1)];
+            size_t sequence = target->sequence.load(std::memory_order_acquire);
+            long diff = (long) sequence - (long) pos;
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        target->value = std::move(value);
+        target->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest published value, only called by the consumer thread.
+     *
+     * @param value Receives the value on success.
+     * @return False when nothing is published.
+     */
+    bool try_pop(T& value) {
+        cell& target = cells[dequeuePos & (N - 1)];
+        size_t sequence = target.sequence.load(std::memory_order_acquire);
+        if (sequence != dequeuePos + 1) {
+            return false;
+        }
+
+        value = std::move(target.value);
+        // Hand the cell back to producers for the next lap
+        target.sequence.store(dequeuePos + N, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+};
+
+/**
+ * @brief Bounded lock-free ring for exactly one producer and one consumer.
+ *
+ * @tparam T Element type, default constructible and movable.
+ * @tparam N Capacity, must be a power of two.
+ */
+template <typename T, size_t N>
+class spscqueue {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+    T cells[N];
+    alignas(64) std::atomic<size_t> head;   // Next cell read by the consumer
+    alignas(64) std::atomic<size_t> tail;   // Next cell written by the producer
+
+public:
+    spscqueue() : head(0), tail(0) {}
+
+    /**
+     * @brief Publishes a value, only called by the producer thread.
+     *
+     * @param value Value moved into the queue on success.
+     * @return False when the queue is full, the value is left untouched.
+     */
+    bool try_push(T& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+
+        cells[pos & (N - 1)] = std::move(value);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest value, only called by the consumer thread.
+     *
+     * @param value Receives the value on success.
+     * @return False when the queue is empty.
+     */
+    bool try_pop(T& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(cells[pos & (N - 1)]);
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // QUEUE_H
@@ -0,0 +1,69 @@
+#include "store.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+void store_owned_files(localstore& store, const unordered_map<string, hashes>& files) {
+    lock_guard<mutex> guard(store.lock);
+
+    for (const auto& [fileName, data] : files) {
+        store.files[fileName] = data.hashesCurr;
+
+        for (int sIdx = 0; sIdx < (int) data.hashesCurr.size(); ++sIdx) {
+            if (data.hashesCurr[sIdx].empty()) {
+                continue; // Not restored from the checkpoint
+            }
+
+            char hash[HASH_SIZE] = {0};
+            memcpy(hash, data.hashesCurr[sIdx].data(), min(data.hashesCurr[sIdx].size(), (size_t) HASH_SIZE));
+            store.digests.emplace(hash, HASH_SIZE);
+
+            if (store.window) {
+                window_publish(*store.window, window_slot(*store.window, fileName.c_str(), sIdx), hash);
+            }
+        }
+    }
+}
+
+void store_segment(localstore& store, const string& file,
+    int segment, int segmentsNo, const char* hash) {
+
+    lock_guard<mutex> guard(store.lock);
+
+    vector<string>& segments = store.files[file];
+    if ((int) segments.size() < segmentsNo) {
+        segments.resize(segmentsNo);
+    }
+    segments[segment].assign(hash, HASH_SIZE);
+    store.digests.emplace(hash, HASH_SIZE);
+
+    if (store.window) {
+        window_publish(*store.window, window_slot(*store.window, file.c_str(), segment), hash);
+    }
+}
+
+bool lookup_segment(localstore& store, const string& file, int segment, char* hash) {
+    lock_guard<mutex> guard(store.lock);
+
+    auto it = store.files.find(file);
+    if (it == store.files.end() || segment < 0 || segment >= (int) it->second.size()) {
+        return false;
+    }
+
+    const string& segmentHash = it->second[segment];
+    if (segmentHash.empty()) {
+        return false;
+    }
+
+    memset(hash, 0, HASH_SIZE);
+    memcpy(hash, segmentHash.data(), min(segmentHash.size(), (size_t) HASH_SIZE));
+    return true;
+}
+
+bool lookup_digest(localstore& store, const char* digest) {
+    lock_guard<mutex> guard(store.lock);
+
+    return store.digests.count(string(digest, HASH_SIZE)) > 0;
+}
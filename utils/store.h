@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef STORE_H
+#define STORE_H 1
+
+#include "file_info.h"
+#include "window.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+struct localstore {
+    std::mutex lock;                                                // Shared by download and upload threads
+    std::unordered_map<std::string, std::vector<std::string>> files; // Segments by file, empty if not owned
+    std::unordered_set<std::string> digests;                        // Hashes of every owned segment, any file
+    segmentwindow* window = nullptr;                                // Slots mirroring the owned segments
+};
+
+/**
+ * @brief Fills the store with the files read from the client input or restored from checkpoints.
+ *
+ * @param store Reference to the local segment store.
+ * @param files Map containing the hashes of the owned files, empty strings for missing segments.
+ */
+void store_owned_files(localstore& store, const std::unordered_map<std::string, hashes>& files);
+
+/**
+ * @brief Saves a downloaded segment so it can be served to other clients,
+ * by message and through the segment window.
+ *
+ * @param store Reference to the local segment store.
+ * @param file Name of the file.
+ * @param segment Index of the segment.
+ * @param segmentsNo Total number of segments of the file.
+ * @param hash Segment payload, HASH_SIZE characters.
+ */
+void store_segment(localstore& store, const std::string& file,
+    int segment, int segmentsNo, const char* hash);
+
+/**
+ * @brief Copies an owned segment out of the store.
+ *
+ * @param store Reference to the local segment store.
+ * @param file Name of the file.
+ * @param segment Index of the segment.
+ * @param hash Buffer of HASH_SIZE characters receiving the payload.
+ * @return True if the segment is owned.
+ */
+bool lookup_segment(localstore& store, const std::string& file, int segment, char* hash);
+
+/**
+ * @brief Tells whether a segment with this content is owned, whatever file it came from.
+ *
+ * @param store Reference to the local segment store.
+ * @param digest Segment hash, HASH_SIZE characters.
+ * @return True if the content is owned.
+ */
+bool lookup_digest(localstore& store, const char* digest);
+
+#endif // STORE_H
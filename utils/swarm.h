@@ -8,6 +8,15 @@
 
 #define TRACKER_RANK 0
 
+// Message tags, every tag is used in a single direction
+#define TAG_SEGMENT_REQUEST 0   // Downloader -> provider: asks for a segment
+#define TAG_SEGMENT_REPLY 1     // Provider -> downloader: the segment or its status
+#define TAG_PROGRESS 2          // Client -> tracker: batched progress update
+#define TAG_SWARM_REQUEST 3     // Client -> tracker: asks for the swarm of a file
+#define TAG_SWARM_REPLY 4       // Tracker -> client: the swarm of a file
+#define TAG_SEGMENT_CANCEL 5    // Downloader -> provider: withdraws a duplicate endgame request
+#define TAG_FIN 6               // Client -> tracker: every wanted file was downloaded
+
 enum peertype {
     SEED,
     PEER,
@@ -0,0 +1,106 @@
+#include "window.h"
+#include "logger.h"
+
+#include <cstring>
+
+using namespace std;
+
+void window_setup(segmentwindow& window, filecatalog& catalog, const swarmconfig& config,
+    int numtasks, int rank) {
+
+    if (config.rmaMode == RMA_OFF) {
+        return;
+    }
+
+    MPI_Bcast(&catalog, sizeof(filecatalog), MPI_BYTE, TRACKER_RANK, MPI_COMM_WORLD);
+    window.catalog = catalog;
+    window.enabled = true;
+
+    // The tracker takes part in the collectives but exposes nothing
+    MPI_Aint size = rank == TRACKER_RANK ? 0 : (MPI_Aint) catalog.filesNo * MAX_CHUNKS * sizeof(windowslot);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &window.nodeComm);
+    MPI_Win_allocate_shared(size, sizeof(windowslot), info, window.nodeComm, &window.slots, &window.sharedWin);
+    MPI_Win_create(window.slots, size, sizeof(windowslot), MPI_INFO_NULL, MPI_COMM_WORLD, &window.worldWin);
+    MPI_Info_free(&info);
+    memset(window.slots, 0, size);
+
+    // Map the world ranks of the node to their slots
+    MPI_Group worldGroup, nodeGroup;
+    MPI_Comm_group(MPI_COMM_WORLD, &worldGroup);
+    MPI_Comm_group(window.nodeComm, &nodeGroup);
+
+    vector<int> worldRanks(numtasks), nodeRanks(numtasks);
+    for (int rIdx = 0; rIdx < numtasks; ++rIdx) {
+        worldRanks[rIdx] = rIdx;
+    }
+    MPI_Group_translate_ranks(worldGroup, numtasks, worldRanks.data(), nodeGroup, nodeRanks.data());
+
+    window.peers.assign(numtasks, nullptr);
+    for (int rIdx = 0; rIdx < numtasks; ++rIdx) {
+        if (nodeRanks[rIdx] == MPI_UNDEFINED) {
+            continue;
+        }
+
+        MPI_Aint peerSize = 0;
+        int dispUnit = 0;
+        windowslot* base = nullptr;
+        MPI_Win_shared_query(window.sharedWin, nodeRanks[rIdx], &peerSize, &dispUnit, &base);
+        window.peers[rIdx] = peerSize > 0 ? base : nullptr;
+    }
+    MPI_Group_free(&worldGroup);
+    MPI_Group_free(&nodeGroup);
+
+    // No slot is read before every rank cleared its own
+    MPI_Barrier(MPI_COMM_WORLD);
+    LOG_DEBUG("window_setup", LOG_NONE, nullptr, LOG_NONE, (int) size);
+}
+
+void window_free(segmentwindow& window) {
+    if (!window.enabled) {
+        return;
+    }
+
+    MPI_Win_free(&window.worldWin);
+    MPI_Win_free(&window.sharedWin);
+    MPI_Comm_free(&window.nodeComm);
+    window.slots = nullptr;
+    window.peers.clear();
+    window.enabled = false;
+}
+
+int window_slot(const segmentwindow& window, const char* file, int segment) {
+    if (!window.enabled || segment < 0 || segment >= MAX_CHUNKS) {
+        return -1;
+    }
+
+    for (int fIdx = 0; fIdx < window.catalog.filesNo; ++fIdx) {
+        if (strncmp(window.catalog.fileNames[fIdx], file, MAX_FILENAME) == 0) {
+            return fIdx * MAX_CHUNKS + segment;
+        }
+    }
+    return -1;
+}
+
+void window_publish(segmentwindow& window, int slot, const char* hash) {
+    if (!window.enabled || slot < 0) {
+        return;
+    }
+
+    // Readers on the node use plain loads, the release store orders the hash before the flag
+    windowslot& target = window.slots[slot];
+    memcpy(target.hash, hash, HASH_SIZE);
+    __atomic_store_n(&target.valid, 1, __ATOMIC_RELEASE);
+}
+
+bool window_load(const windowslot& slot, char* hash) {
+    if (!__atomic_load_n(&slot.valid, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    memcpy(hash, slot.hash, HASH_SIZE);
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef WINDOW_H
+#define WINDOW_H 1
+
+#include "config.h"
+#include "file_info.h"
+
+#include <mpi.h>
+#include <vector>
+
+#define MAX_CATALOG 64  // Files exposed through the segment windows, others are served by messages
+
+// Segment storage of a client, one slot per (catalog file, segment) pair
+struct windowslot {
+    char valid;                 // Set once the hash is written, never cleared
+    char hash[HASH_SIZE];       // Segment payload
+};
+
+// Files known by the tracker, their index gives the position of their slots
+struct filecatalog {
+    int filesNo;
+    char fileNames[MAX_CATALOG][MAX_FILENAME];
+};
+
+struct segmentwindow {
+    bool enabled = false;               // Windows were created, config.rmaMode is not RMA_OFF
+    filecatalog catalog;                // Same on every rank, broadcast by the tracker
+    MPI_Comm nodeComm = MPI_COMM_NULL;  // Ranks sharing memory with this one
+    MPI_Win sharedWin = MPI_WIN_NULL;   // Slots of the node ranks, read with plain loads
+    MPI_Win worldWin = MPI_WIN_NULL;    // Same slots exposed to every rank, read with MPI_Get
+    windowslot* slots = nullptr;        // Slots of this rank
+    std::vector<windowslot*> peers;     // Slots of the same node ranks by world rank, nullptr elsewhere
+};
+
+/**
+ * @brief Broadcasts the file catalog and exposes the segment slots of every client.
+ * Slots are allocated with MPI_Win_allocate_shared on the ranks of the node, the same
+ * memory backs a window over MPI_COMM_WORLD for ranks of other nodes.
+ * Collective over MPI_COMM_WORLD, nothing is created when config.rmaMode is RMA_OFF.
+ *
+ * @param window Reference to the windows of the calling rank.
+ * @param catalog Catalog filled by the tracker, received by the clients.
+ * @param config Run configuration broadcast by the tracker.
+ * @param numtasks Total number of tasks including the tracker.
+ * @param rank Rank of the current task.
+ */
+void window_setup(segmentwindow& window, filecatalog& catalog, const swarmconfig& config,
+    int numtasks, int rank);
+
+/**
+ * @brief Frees the windows, collective over MPI_COMM_WORLD once no rank reads them anymore.
+ *
+ * @param window Reference to the windows of the calling rank.
+ */
+void window_free(segmentwindow& window);
+
+/**
+ * @brief Finds the slot of a segment, the same on every rank.
+ *
+ * @param window Reference to the windows of the calling rank.
+ * @param file Name of the file.
+ * @param segment Index of the segment.
+ * @return The slot index, -1 when the segment is not exposed.
+ */
+int window_slot(const segmentwindow& window, const char* file, int segment);
+
+/**
+ * @brief Writes an owned segment in the local slots, the hash is visible before the flag.
+ *
+ * @param window Reference to the windows of the calling rank.
+ * @param slot Slot of the segment, ignored when negative.
+ * @param hash Segment payload, HASH_SIZE characters.
+ */
+void window_publish(segmentwindow& window, int slot, const char* hash);
+
+/**
+ * @brief Copies a slot of a rank sharing memory with this one.
+ *
+ * @param slot Slot read in place.
+ * @param hash Buffer of HASH_SIZE characters receiving the payload.
+ * @return True if the slot holds a segment.
+ */
+bool window_load(const windowslot& slot, char* hash);
+
+#endif // WINDOW_H